@@ -3,8 +3,256 @@
 #include <string>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <new>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <sstream>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <map>
+#include <functional>
+#include <iterator>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <intrin.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
+// Подсказка процессору заранее загрузить кэш-линию; адрес может быть и за пределами массива
+inline void prefetchRead(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    (void)address;
+#endif
+}
+
+inline int countTrailingZeros(unsigned long long value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(value);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    int count = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Счётчики для поиска причин всплесков задержки: повороты, длины путей поиска, выделения узлов,
+// глубина вложенности при разборе и гистограммы задержек операций. Собираются только при сборке
+// с -DTREE_STATS; без него макрос TREE_STAT убирает все обращения к ним вместе с аргументами
+#ifdef TREE_STATS
+#define TREE_STAT(...) __VA_ARGS__
+
+// Пакетные операции обрабатывают много ключей одним вызовом и замеряются отдельно, по замеру на пачку
+enum TreeOperation { OP_INSERT, OP_DELETE, OP_SEARCH, OP_INSERT_BATCH, OP_DELETE_BATCH, OP_SEARCH_BATCH, OP_KINDS };
+const char* const TREE_OPERATION_NAMES[OP_KINDS] = { "insert", "delete", "search", "insert_batch", "delete_batch",
+                                                     "search_batch" };
+
+// Корзина i гистограммы задержек — от 2^(i-1) до 2^i наносекунд, корзина 0 — меньше 1 нс
+const int LATENCY_BUCKETS = 40;
+// Длина пути — число узлов, с которыми сравнивался ключ
+const int PATH_BUCKETS = 65;
+
+// Счётчики атомарны: повороты и выделения идут и из задач пула потоков
+struct TreeStats {
+    atomic<unsigned long long> leftRotations;
+    atomic<unsigned long long> rightRotations;
+    atomic<unsigned long long> doubleRotations;
+    atomic<unsigned long long> searchPaths[PATH_BUCKETS];
+    atomic<unsigned long long> nodeAllocations;
+    atomic<unsigned long long> nodeFrees;
+    atomic<unsigned long long> slabAllocations;
+    atomic<int> parseMaxDepth;
+    atomic<unsigned long long> latency[OP_KINDS][LATENCY_BUCKETS];
+    atomic<unsigned long long> latencyKeys[OP_KINDS];
+};
+
+TreeStats treeStats;
+
+inline void countStat(atomic<unsigned long long>& counter, unsigned long long amount = 1) {
+    counter.fetch_add(amount, memory_order_relaxed);
+}
+
+inline void recordSearchPath(int length, unsigned long long searches = 1) {
+    countStat(treeStats.searchPaths[length < PATH_BUCKETS ? length : PATH_BUCKETS - 1], searches);
+}
+
+inline void recordParseDepth(int depth) {
+    int seen = treeStats.parseMaxDepth.load(memory_order_relaxed);
+    while (depth > seen && !treeStats.parseMaxDepth.compare_exchange_weak(seen, depth, memory_order_relaxed)) {}
+}
+
+// Замер задержки операции от создания до выхода из области видимости: один замер на вызов,
+// сколько бы ключей он ни обработал; число ключей копится отдельно
+class OperationTimer {
+public:
+    explicit OperationTimer(TreeOperation operation, size_t keys = 1)
+        : operation(operation), keys(keys), start(chrono::steady_clock::now()) {}
+    OperationTimer(const OperationTimer&) = delete;
+    OperationTimer& operator=(const OperationTimer&) = delete;
+
+    ~OperationTimer() {
+        long long ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        int bucket = 0;
+        while (ns > 0 && bucket < LATENCY_BUCKETS - 1) {
+            ns >>= 1;
+            bucket++;
+        }
+        countStat(treeStats.latency[operation][bucket]);
+        countStat(treeStats.latencyKeys[operation], keys);
+    }
+
+private:
+    TreeOperation operation;
+    size_t keys;
+    chrono::steady_clock::time_point start;
+};
+
+// Снимок счётчиков: обычные числа, которые можно сравнивать и выводить
+struct TreeStatsSnapshot {
+    unsigned long long leftRotations;
+    unsigned long long rightRotations;
+    unsigned long long doubleRotations;
+    unsigned long long searchPaths[PATH_BUCKETS];
+    unsigned long long nodeAllocations;
+    unsigned long long nodeFrees;
+    unsigned long long slabAllocations;
+    int parseMaxDepth;
+    unsigned long long latency[OP_KINDS][LATENCY_BUCKETS];
+    unsigned long long latencyKeys[OP_KINDS];
+};
+
+TreeStatsSnapshot takeTreeStatsSnapshot() {
+    TreeStatsSnapshot snapshot;
+    snapshot.leftRotations = treeStats.leftRotations.load(memory_order_relaxed);
+    snapshot.rightRotations = treeStats.rightRotations.load(memory_order_relaxed);
+    snapshot.doubleRotations = treeStats.doubleRotations.load(memory_order_relaxed);
+    for (int i = 0; i < PATH_BUCKETS; i++) snapshot.searchPaths[i] = treeStats.searchPaths[i].load(memory_order_relaxed);
+    snapshot.nodeAllocations = treeStats.nodeAllocations.load(memory_order_relaxed);
+    snapshot.nodeFrees = treeStats.nodeFrees.load(memory_order_relaxed);
+    snapshot.slabAllocations = treeStats.slabAllocations.load(memory_order_relaxed);
+    snapshot.parseMaxDepth = treeStats.parseMaxDepth.load(memory_order_relaxed);
+    for (int op = 0; op < OP_KINDS; op++) {
+        for (int i = 0; i < LATENCY_BUCKETS; i++) snapshot.latency[op][i] = treeStats.latency[op][i].load(memory_order_relaxed);
+        snapshot.latencyKeys[op] = treeStats.latencyKeys[op].load(memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void resetTreeStats() {
+    treeStats.leftRotations.store(0, memory_order_relaxed);
+    treeStats.rightRotations.store(0, memory_order_relaxed);
+    treeStats.doubleRotations.store(0, memory_order_relaxed);
+    for (auto& bucket : treeStats.searchPaths) bucket.store(0, memory_order_relaxed);
+    treeStats.nodeAllocations.store(0, memory_order_relaxed);
+    treeStats.nodeFrees.store(0, memory_order_relaxed);
+    treeStats.slabAllocations.store(0, memory_order_relaxed);
+    treeStats.parseMaxDepth.store(0, memory_order_relaxed);
+    for (auto& histogram : treeStats.latency) {
+        for (auto& bucket : histogram) bucket.store(0, memory_order_relaxed);
+    }
+    for (auto& keys : treeStats.latencyKeys) keys.store(0, memory_order_relaxed);
+}
+
+// Верхняя граница корзины, в которую попадает доля fraction всех замеров
+unsigned long long latencyPercentileNs(const unsigned long long* histogram, unsigned long long total, double fraction) {
+    unsigned long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > 0 && seen >= fraction * total) return 1ull << i;
+    }
+    return 0;
+}
+
+// Снимок в JSON. Повороты двойного поворота входят и в счётчики левых и правых, поэтому
+// одиночные — это все повороты минус два на каждый двойной. У пакетных операций count — число
+// пачек, keys — число ключей в них
+void writeTreeStatsJson(ostream& out, const TreeStatsSnapshot& s) {
+    unsigned long long rotations = s.leftRotations + s.rightRotations;
+    out << "{\n  \"rotations\": {\"left\": " << s.leftRotations << ", \"right\": " << s.rightRotations
+        << ", \"single\": " << rotations - 2 * s.doubleRotations << ", \"double\": " << s.doubleRotations << "},\n";
+
+    unsigned long long searches = 0, pathTotal = 0;
+    int maxPath = 0;
+    for (int i = 0; i < PATH_BUCKETS; i++) {
+        searches += s.searchPaths[i];
+        pathTotal += s.searchPaths[i] * i;
+        if (s.searchPaths[i]) maxPath = i;
+    }
+    out << "  \"search\": {\"count\": " << searches << ", \"mean_path\": " << (searches ? (double)pathTotal / searches : 0)
+        << ", \"max_path\": " << maxPath << ", \"path_histogram\": [";
+    for (int i = 0; i <= maxPath; i++) out << (i ? ", " : "") << s.searchPaths[i];
+    out << "]},\n";
+
+    out << "  \"nodes\": {\"allocated\": " << s.nodeAllocations << ", \"freed\": " << s.nodeFrees
+        << ", \"slabs\": " << s.slabAllocations << "},\n";
+    out << "  \"parse_max_depth\": " << s.parseMaxDepth << ",\n";
+
+    out << "  \"latency_ns\": {";
+    for (int op = 0; op < OP_KINDS; op++) {
+        const unsigned long long* histogram = s.latency[op];
+        unsigned long long total = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) total += histogram[i];
+        out << (op ? "," : "") << "\n    \"" << TREE_OPERATION_NAMES[op] << "\": {\"count\": " << total
+            << ", \"keys\": " << s.latencyKeys[op] << ", \"p50\": " << latencyPercentileNs(histogram, total, 0.5)
+            << ", \"p99\": " << latencyPercentileNs(histogram, total, 0.99)
+            << ", \"p999\": " << latencyPercentileNs(histogram, total, 0.999) << ", \"buckets\": [";
+        bool first = true;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            if (!histogram[i]) continue;
+            out << (first ? "" : ", ") << "{\"le\": " << (1ull << i) << ", \"count\": " << histogram[i] << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "\n  }\n}\n";
+}
+
+void printTreeStats(bool reset) {
+    writeTreeStatsJson(cout, takeTreeStatsSnapshot());
+    if (reset) resetTreeStats();
+}
+#else
+#define TREE_STAT(...)
+
+void printTreeStats(bool) {
+    cout << "Статистика не собирается: программа собрана без TREE_STATS" << endl;
+}
+#endif
+
 // Структура для обычного двоичного дерева
 struct BinaryTree {
     int data;
@@ -14,117 +262,191 @@ struct BinaryTree {
     BinaryTree(int val) : data(val), left(nullptr), right(nullptr) {}
 };
 
-// Структура для АВЛ дерева
+// Структура для АВЛ дерева; size — число узлов в поддереве, для порядковых статистик
 struct AVLTree {
     int data;
     AVLTree* left;
     AVLTree* right;
     int height;
+    int size;
 
-    AVLTree(int val) : data(val), left(nullptr), right(nullptr), height(1) {}
+    AVLTree(int val) : data(val), left(nullptr), right(nullptr), height(1), size(1) {}
 };
 
-struct BinaryTreeStack {
-    BinaryTree** data;
-    int capacity;
-    int top;
+// Пул узлов: память берётся блоками, освобождённые узлы переиспользуются через список свободных,
+// а всё дерево целиком освобождается вызовом release() без обхода узлов
+template <typename Node>
+class NodeArena {
+public:
+    static const int SLAB_NODES = 4096;
 
-    BinaryTreeStack(int size) {
-        capacity = size;
-        data = new BinaryTree * [capacity];
-        top = -1;
-    }
+    NodeArena() : freeList(nullptr), slabUsed(SLAB_NODES), nodesCreated(0), nodesDestroyed(0), slabsAllocated(0) {}
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
 
-    ~BinaryTreeStack() {
-        delete[] data;
+    ~NodeArena() {
+        release();
     }
 
-    void push(BinaryTree* node) {
-        if (top < capacity - 1) {
-            data[++top] = node;
+    template <typename... Args>
+    Node* create(Args&&... args) {
+        nodesCreated++;
+        TREE_STAT(countStat(treeStats.nodeAllocations);)
+        Slot* slot = freeList;
+        if (slot) {
+            freeList = slot->next;
         }
-    }
-
-    BinaryTree* pop() {
-        if (top >= 0) {
-            return data[top--];
+        else {
+            if (slabUsed == SLAB_NODES) {
+                slabs.push_back(new Slot[SLAB_NODES]);
+                slabsAllocated++;
+                TREE_STAT(countStat(treeStats.slabAllocations);)
+                slabUsed = 0;
+            }
+            slot = &slabs.back()[slabUsed++];
         }
-        return nullptr;
+        return new (slot->storage) Node(forward<Args>(args)...);
     }
 
-    bool isEmpty() {
-        return top == -1;
+    // Непрерывный блок из count неинициализированных узлов; узлы создаются в нём через placement new
+    // и могут заполняться из разных потоков. Блок освобождается вместе с пулом. Блок встаёт в конец
+    // slabs, поэтому текущий слой закрывается: следующий create() начнёт новый, а не займёт узлы блока
+    Node* allocateBlock(size_t count) {
+        static_assert(sizeof(Slot) == sizeof(Node), "узлы блока должны лежать вплотную");
+        slabs.push_back(new Slot[count]);
+        slabUsed = SLAB_NODES;
+        nodesCreated += count;
+        slabsAllocated++;
+        TREE_STAT(countStat(treeStats.nodeAllocations, count);)
+        TREE_STAT(countStat(treeStats.slabAllocations);)
+        return reinterpret_cast<Node*>(slabs.back());
     }
-};
-
-struct AVLTreeStack {
-    AVLTree** data;
-    int capacity;
-    int top;
 
-    AVLTreeStack(int size) {
-        capacity = size;
-        data = new AVLTree * [capacity];
-        top = -1;
+    // Возврат последнего выделенного блока из count узлов, если они так и не понадобились
+    void releaseLastBlock(Node* block, size_t count) {
+        if (slabs.empty() || reinterpret_cast<Node*>(slabs.back()) != block) return;
+        delete[] slabs.back();
+        slabs.pop_back();
+        nodesDestroyed += count;
+        TREE_STAT(countStat(treeStats.nodeFrees, count);)
     }
 
-    ~AVLTreeStack() {
-        delete[] data;
+    void destroy(Node* node) {
+        nodesDestroyed++;
+        TREE_STAT(countStat(treeStats.nodeFrees);)
+        node->~Node();
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        slot->next = freeList;
+        freeList = slot;
     }
 
-    void push(AVLTree* node) {
-        if (top < capacity - 1) {
-            data[++top] = node;
+    // Деструкторы живых узлов не вызываются: для узлов с нетривиальными полями их сначала удаляют через destroy()
+    void release() {
+        for (Slot* slab : slabs) {
+            delete[] slab;
         }
+        // Живые узлы освобождаются вместе со слоями и тоже считаются освобождёнными
+        TREE_STAT(countStat(treeStats.nodeFrees, nodesCreated - nodesDestroyed);)
+        nodesDestroyed = nodesCreated;
+        slabs.clear();
+        freeList = nullptr;
+        slabUsed = SLAB_NODES;
     }
 
-    AVLTree* pop() {
-        if (top >= 0) {
-            return data[top--];
-        }
-        return nullptr;
+    // Счётчики за всё время жизни пула, для замеров
+    size_t createdNodes() const {
+        return nodesCreated;
     }
 
-    bool isEmpty() {
-        return top == -1;
+    size_t allocatedSlabs() const {
+        return slabsAllocated;
     }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+    vector<Slot*> slabs;
+    Slot* freeList;
+    int slabUsed;
+    size_t nodesCreated;
+    size_t nodesDestroyed;
+    size_t slabsAllocated;
 };
 
-struct BinaryTreeQueue {
-    BinaryTree** data;
+// В программе одновременно существует одно двоичное и одно АВЛ дерево, поэтому пулы общие
+NodeArena<BinaryTree> binaryTreeArena;
+NodeArena<AVLTree> avlTreeArena;
+
+// Увеличивается при каждом изменении АВЛ дерева, по нему устаревает плоский снимок
+atomic<unsigned long long> avlTreeVersion(0);
+
+// Растущий кольцевой буфер для итеративных обходов: работает как стек (push/pop)
+// и как очередь (enqueue/dequeue), при заполнении удваивает ёмкость
+template <typename T>
+struct TraversalBuffer {
+    T* data;
     int capacity;
     int front;
-    int rear;
     int count;
 
-    BinaryTreeQueue(int size) {
-        capacity = size;
-        data = new BinaryTree * [capacity];
+    TraversalBuffer() : data(nullptr), capacity(0), front(0), count(0) {}
+    TraversalBuffer(const TraversalBuffer&) = delete;
+    TraversalBuffer& operator=(const TraversalBuffer&) = delete;
+
+    ~TraversalBuffer() {
+        delete[] data;
+    }
+
+    void reserve(int size) {
+        if (size <= capacity) return;
+
+        int newCapacity = capacity ? capacity : 16;
+        while (newCapacity < size) newCapacity *= 2;
+
+        T* newData = new T[newCapacity];
+        for (int i = 0; i < count; i++) {
+            newData[i] = data[(front + i) & (capacity - 1)];
+        }
+        delete[] data;
+        data = newData;
+        capacity = newCapacity;
+        front = 0;
+    }
+
+    void clear() {
         front = 0;
-        rear = -1;
         count = 0;
     }
 
-    ~BinaryTreeQueue() {
-        delete[] data;
+    void push(T value) {
+        if (count == capacity) reserve(count + 1);
+        data[(front + count) & (capacity - 1)] = value;
+        count++;
     }
 
-    void enqueue(BinaryTree* node) {
-        if (count < capacity) {
-            rear = (rear + 1) % capacity;
-            data[rear] = node;
-            count++;
-        }
+    T pop() {
+        if (count == 0) return T();
+        count--;
+        return data[(front + count) & (capacity - 1)];
     }
 
-    BinaryTree* dequeue() {
-        if (count > 0) {
-            BinaryTree* node = data[front];
-            front = (front + 1) % capacity;
-            count--;
-            return node;
-        }
-        return nullptr;
+    T& back() {
+        return data[(front + count - 1) & (capacity - 1)];
+    }
+
+    void enqueue(T value) {
+        push(value);
+    }
+
+    T dequeue() {
+        if (count == 0) return T();
+        T value = data[front];
+        front = (front + 1) & (capacity - 1);
+        count--;
+        return value;
     }
 
     bool isEmpty() {
@@ -132,464 +454,5077 @@ struct BinaryTreeQueue {
     }
 };
 
-struct AVLTreeQueue {
-    AVLTree** data;
-    int capacity;
-    int front;
-    int rear;
-    int count;
+// Буферы обходов хранятся в потоке и переиспользуются, поэтому повторные обходы не выделяют память.
+// Slot различает буферы, нужные одному обходу одновременно
+template <typename T, int Slot = 0>
+TraversalBuffer<T>& traversalScratch(int reserveSize = 0) {
+    static thread_local TraversalBuffer<T> buffer;
+    buffer.clear();
+    buffer.reserve(reserveSize);
+    return buffer;
+}
 
-    AVLTreeQueue(int size) {
-        capacity = size;
-        data = new AVLTree * [capacity];
-        front = 0;
-        rear = -1;
-        count = 0;
+// Буферизованный вывод в stdout: данные копятся в большом буфере и пишутся одним fwrite при
+// заполнении или явном flush(). Как streambuf он подменяет буфер cout, и тогда функции,
+// печатающие через cout, тоже пишут в этот буфер; endl при этом не сбрасывает его
+class BufferedWriter : public streambuf {
+public:
+    explicit BufferedWriter(FILE* target, size_t capacity = 1 << 20) : target(target), buffer(capacity) {
+        setp(buffer.data(), buffer.data() + buffer.size());
     }
 
-    ~AVLTreeQueue() {
-        delete[] data;
+    ~BufferedWriter() override {
+        flush();
+    }
+
+    void writeInt(int value) {
+        if (epptr() - pptr() < 16) flush();
+        pbump((int)(to_chars(pptr(), epptr(), value).ptr - pptr()));
+    }
+
+    void write(const char* text, size_t length) {
+        xsputn(text, (streamsize)length);
+    }
+
+    void write(const char* text) {
+        write(text, strlen(text));
+    }
+
+    void put(char c) {
+        sputc(c);
+    }
+
+    void flush() {
+        fwrite(pbase(), 1, pptr() - pbase(), target);
+        fflush(target);
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+protected:
+    int overflow(int c) override {
+        flush();
+        if (c != EOF) sputc((char)c);
+        return c == EOF ? 0 : c;
     }
 
-    void enqueue(AVLTree* node) {
-        if (count < capacity) {
-            rear = (rear + 1) % capacity;
-            data[rear] = node;
-            count++;
+    streamsize xsputn(const char* text, streamsize count) override {
+        if (count > epptr() - pptr()) {
+            flush();
+            if (count > epptr() - pptr()) {
+                fwrite(text, 1, (size_t)count, target);
+                return count;
+            }
         }
+        memcpy(pptr(), text, (size_t)count);
+        pbump((int)count);
+        return count;
+    }
+
+    int sync() override {
+        return 0;
+    }
+
+private:
+    FILE* target;
+    vector<char> buffer;
+};
+
+// Приёмники ключей для обходов: обход вызывает sink(key) для каждого узла в своём порядке.
+// Ключи в памяти
+struct VectorSink {
+    vector<int>& elements;
+
+    void operator()(int key) {
+        elements.push_back(key);
+    }
+};
+
+// Текст в поток через собственный буфер: ключи форматируются to_chars и уходят в поток
+// крупными кусками, а не по одному
+class StreamSink {
+public:
+    explicit StreamSink(ostream& out) : out(out), used(0) {}
+    StreamSink(const StreamSink&) = delete;
+    StreamSink& operator=(const StreamSink&) = delete;
+
+    ~StreamSink() {
+        flush();
+    }
+
+    void operator()(int key) {
+        if (used > sizeof(buffer) - 16) flush();
+        used = (size_t)(to_chars(buffer + used, buffer + sizeof(buffer), key).ptr - buffer);
+        buffer[used++] = ' ';
+    }
+
+    void flush() {
+        out.write(buffer, (streamsize)used);
+        used = 0;
+    }
+
+private:
+    ostream& out;
+    size_t used;
+    char buffer[1 << 14];
+};
+
+// Текст в файл через BufferedWriter
+struct WriterSink {
+    BufferedWriter& out;
+
+    void operator()(int key) {
+        out.writeInt(key);
+        out.put(' ');
+    }
+};
+
+// Для замеров: ключи только суммируются, чтобы обход не был выброшен компилятором
+struct NullSink {
+    size_t count = 0;
+    long long checksum = 0;
+
+    void operator()(int key) {
+        count++;
+        checksum += key;
     }
+};
 
-    AVLTree* dequeue() {
-        if (count > 0) {
-            AVLTree* node = data[front];
-            front = (front + 1) % capacity;
-            count--;
-            return node;
+// Пул потоков с перехватом задач: у каждого потока своя очередь, свои задачи он берёт с конца,
+// а при пустой очереди забирает самые старые задачи из начала чужих очередей.
+// Задачи от потоков вне пула попадают в отдельную общую очередь
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned workerCount) : stopping(false), queued(0) {
+        for (unsigned i = 0; i <= workerCount; i++) {
+            queues.emplace_back(new TaskQueue());
+        }
+        for (unsigned i = 0; i < workerCount; i++) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
         }
-        return nullptr;
     }
 
-    bool isEmpty() {
-        return count == 0;
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers) worker.join();
+    }
+
+    // Число потоков, выполняющих задачи, включая ожидающий в TaskGroup::wait
+    unsigned threadCount() const {
+        return (unsigned)workers.size() + 1;
+    }
+
+    void submit(function<void()> task) {
+        TaskQueue& queue = *queues[ownQueueIndex()];
+        {
+            lock_guard<mutex> lock(queue.lock);
+            queue.tasks.push_back(move(task));
+        }
+        queued.fetch_add(1, memory_order_release);
+        {
+            lock_guard<mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Выполнить одну задачу, если она есть: свою последнюю или украденную
+    bool runPendingTask() {
+        size_t self = ownQueueIndex();
+        function<void()> task;
+        if (!takeTask(self, task)) return false;
+        queued.fetch_sub(1, memory_order_relaxed);
+        task();
+        return true;
+    }
+
+private:
+    struct TaskQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    size_t ownQueueIndex() const {
+        return currentPool == this ? currentIndex : workers.size();
+    }
+
+    bool takeTask(size_t self, function<void()>& task) {
+        {
+            TaskQueue& own = *queues[self];
+            lock_guard<mutex> lock(own.lock);
+            if (!own.tasks.empty()) {
+                task = move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            TaskQueue& victim = *queues[(self + i) % queues.size()];
+            lock_guard<mutex> lock(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned index) {
+        currentPool = this;
+        currentIndex = index;
+        while (true) {
+            if (runPendingTask()) continue;
+
+            unique_lock<mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return stopping || queued.load(memory_order_acquire) > 0; });
+            if (stopping && queued.load(memory_order_acquire) == 0) return;
+        }
     }
+
+    static thread_local const WorkStealingPool* currentPool;
+    static thread_local size_t currentIndex;
+
+    vector<unique_ptr<TaskQueue>> queues;
+    vector<thread> workers;
+    mutex sleepMutex;
+    condition_variable wake;
+    bool stopping;
+    atomic<long long> queued;
 };
 
-// Функции для обычного двоичного дерева
+thread_local const WorkStealingPool* WorkStealingPool::currentPool = nullptr;
+thread_local size_t WorkStealingPool::currentIndex = 0;
 
-void dfsBinaryTree(BinaryTree* root) {
-    if (root == nullptr) return;
+// Группа задач fork-join: wait() не просто ждёт, а сам выполняет задачи пула
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkStealingPool& pool) : pool(pool), pending(0) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
 
-    cout << root->data << " ";
-    dfsBinaryTree(root->left);
-    dfsBinaryTree(root->right);
-}
+    ~TaskGroup() {
+        wait();
+    }
 
-void printBinaryTree(BinaryTree* root, int level = 0) {
-    if (root == nullptr) {
-        return;
+    void run(function<void()> task) {
+        pending.fetch_add(1, memory_order_relaxed);
+        pool.submit([this, task]() {
+            task();
+            pending.fetch_sub(1, memory_order_release);
+        });
     }
-    printBinaryTree(root->right, level + 1);
-    cout << setw(level * 4) << "";
-    cout << "--> " << root->data << endl;
-    printBinaryTree(root->left, level + 1);
-}
 
-void collectPreOrder(BinaryTree* root, vector<int>& elements) {
-    if (root == nullptr) return;
+    void wait() {
+        while (pending.load(memory_order_acquire) > 0) {
+            if (!pool.runPendingTask()) this_thread::yield();
+        }
+    }
+
+private:
+    WorkStealingPool& pool;
+    atomic<int> pending;
+};
 
-    elements.push_back(root->data);
-    collectPreOrder(root->left, elements);
-    collectPreOrder(root->right, elements);
+// Общий пул программы: рабочих потоков на один меньше числа ядер, последний — вызывающий
+WorkStealingPool& sharedPool() {
+    static WorkStealingPool pool(max((int)thread::hardware_concurrency(), 1) - 1);
+    return pool;
 }
 
-int countNodes(BinaryTree* root) {
-    if (root == nullptr) return 0;
-    return 1 + countNodes(root->left) + countNodes(root->right);
+// Параллельные обходы для любых узлов с полями data, left и right
+
+// Глубина, начиная с которой поддеревья обходятся отдельными задачами: на ней до 8 поддеревьев на поток
+int parallelSplitDepth(WorkStealingPool& pool) {
+    int splitDepth = 3;
+    while ((1u << splitDepth) < 8 * pool.threadCount()) splitDepth++;
+    return splitDepth;
 }
 
-void deleteBinaryTree(BinaryTree* root) {
-    if (root == nullptr) return;
+// Последовательная свёртка в прямом порядке: visit(acc, node) добавляет узел к накопителю
+template <typename T, typename Node, typename Visit>
+T foldTree(const Node* root, T acc, Visit& visit) {
+    if (!root) return acc;
+
+    TraversalBuffer<const Node*>& stack = traversalScratch<const Node*>();
+    stack.push(root);
+    while (!stack.isEmpty()) {
+        const Node* current = stack.pop();
+        visit(acc, current);
 
-    deleteBinaryTree(root->left);
-    deleteBinaryTree(root->right);
-    delete root;
+        if (current->right) stack.push(current->right);
+        if (current->left) stack.push(current->left);
+    }
+    return acc;
 }
 
-// Функции для АВЛ дерева
+// Параллельная свёртка: узлы выше splitDepth добавляются в вызывающем потоке, поддеревья
+// ниже сворачиваются задачами пула. combine(a, b) склеивает накопители соседних частей и
+// должна быть ассоциативной; части склеиваются слева направо в порядке прямого обхода,
+// поэтому результат равен последовательной свёртке и не зависит от расписания потоков
+template <typename T, typename Node, typename Visit, typename Combine>
+T parallelFoldTree(const Node* root, const T& identity, Visit visit, Combine combine, WorkStealingPool& pool) {
+    if (!root) return identity;
+
+    struct Part {
+        T value;
+        const Node* subtree;
+    };
+    struct Pending {
+        const Node* node;
+        int depth;
+    };
+    int splitDepth = parallelSplitDepth(pool);
+    vector<Part> parts;
+    TraversalBuffer<Pending>& stack = traversalScratch<Pending>();
+    stack.push({ root, 0 });
+    while (!stack.isEmpty()) {
+        Pending current = stack.pop();
+        if (current.depth == splitDepth) {
+            parts.push_back({ identity, current.node });
+            continue;
+        }
+        parts.push_back({ identity, nullptr });
+        visit(parts.back().value, current.node);
+        if (current.node->right) stack.push({ current.node->right, current.depth + 1 });
+        if (current.node->left) stack.push({ current.node->left, current.depth + 1 });
+    }
 
-int getHeight(AVLTree* node) {
-    return node ? node->height : 0;
+    {
+        TaskGroup group(pool);
+        for (Part& part : parts) {
+            if (!part.subtree) continue;
+            group.run([&part, &visit]() { part.value = foldTree(part.subtree, part.value, visit); });
+        }
+        group.wait();
+    }
+
+    T result = identity;
+    for (const Part& part : parts) {
+        result = combine(result, part.value);
+    }
+    return result;
 }
 
-int max(int a, int b) {
-    return (a > b) ? a : b;
+// Сводка по ключам дерева за один параллельный проход
+struct TreeSummary {
+    long long count;
+    long long sum;
+    int minKey;
+    int maxKey;
+};
+
+const TreeSummary EMPTY_TREE_SUMMARY = { 0, 0, INT_MAX, INT_MIN };
+
+struct SummaryVisit {
+    template <typename Node>
+    void operator()(TreeSummary& summary, const Node* node) const {
+        summary.count++;
+        summary.sum += node->data;
+        if (node->data < summary.minKey) summary.minKey = node->data;
+        if (node->data > summary.maxKey) summary.maxKey = node->data;
+    }
+};
+
+TreeSummary combineSummaries(const TreeSummary& a, const TreeSummary& b) {
+    return { a.count + b.count, a.sum + b.sum, a.minKey < b.minKey ? a.minKey : b.minKey,
+             a.maxKey > b.maxKey ? a.maxKey : b.maxKey };
 }
 
-int getBalance(AVLTree* node) {
-    return node ? getHeight(node->left) - getHeight(node->right) : 0;
+template <typename Node>
+TreeSummary summarizeTree(const Node* root, WorkStealingPool& pool) {
+    return parallelFoldTree(root, EMPTY_TREE_SUMMARY, SummaryVisit(), combineSummaries, pool);
 }
 
-bool isBalanced(AVLTree* node) {
-    if (!node) return true;
-    int balance = getBalance(node);
-    return (balance >= -1 && balance <= 1) && isBalanced(node->left) && isBalanced(node->right);
+const size_t PARALLEL_FRONTIER_GRAIN = 1 << 12;
+
+// Задачи task(0..chunks-1) в пуле; один кусок выполняется сразу, без задач
+template <typename Task>
+void runChunksParallel(size_t chunks, Task& task, WorkStealingPool& pool) {
+    if (chunks == 1) {
+        task(0);
+        return;
+    }
+    TaskGroup group(pool);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        group.run([&task, chunk]() { task(chunk); });
+    }
+    group.wait();
 }
 
-void checkBalance(AVLTree* root) {
-    bool balanced = isBalanced(root);
-    cout << "Дерево " << (balanced ? "сбалансировано." : "несбалансировано.") << endl;
+// Обход в ширину по уровням: текущий уровень (фронт) делится на куски по PARALLEL_FRONTIER_GRAIN
+// узлов, куски обрабатываются задачами пула. Сначала каждый кусок посещает свои узлы и считает
+// их детей, затем по префиксным суммам дети записываются в следующий фронт в том же порядке,
+// что и в последовательном обходе. visit(node, index) вызывается из разных потоков и должен
+// быть потокобезопасным; index — номер узла в последовательном обходе в ширину, по нему
+// результат раскладывается в детерминированном порядке. Возвращает число уровней
+template <typename Node, typename Visit>
+int parallelBreadthFirst(const Node* root, Visit visit, WorkStealingPool& pool) {
+    if (!root) return 0;
+
+    vector<const Node*> frontier(1, root);
+    vector<const Node*> next;
+    vector<size_t> childOffsets;
+    size_t levelStart = 0;
+    int levels = 0;
+    while (!frontier.empty()) {
+        size_t chunks = (frontier.size() + PARALLEL_FRONTIER_GRAIN - 1) / PARALLEL_FRONTIER_GRAIN;
+        childOffsets.assign(chunks + 1, 0);
+
+        auto visitChunk = [&](size_t chunk) {
+            size_t begin = chunk * PARALLEL_FRONTIER_GRAIN;
+            size_t end = min(frontier.size(), begin + PARALLEL_FRONTIER_GRAIN);
+            size_t children = 0;
+            for (size_t i = begin; i < end; i++) {
+                visit(frontier[i], levelStart + i);
+                children += (frontier[i]->left != nullptr) + (frontier[i]->right != nullptr);
+            }
+            childOffsets[chunk + 1] = children;
+        };
+        runChunksParallel(chunks, visitChunk, pool);
+
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            childOffsets[chunk + 1] += childOffsets[chunk];
+        }
+        next.resize(childOffsets[chunks]);
+
+        auto expandChunk = [&](size_t chunk) {
+            size_t begin = chunk * PARALLEL_FRONTIER_GRAIN;
+            size_t end = min(frontier.size(), begin + PARALLEL_FRONTIER_GRAIN);
+            const Node** out = next.data() + childOffsets[chunk];
+            for (size_t i = begin; i < end; i++) {
+                if (frontier[i]->left) *out++ = frontier[i]->left;
+                if (frontier[i]->right) *out++ = frontier[i]->right;
+            }
+        };
+        runChunksParallel(chunks, expandChunk, pool);
+
+        levelStart += frontier.size();
+        frontier.swap(next);
+        levels++;
+    }
+    return levels;
 }
 
-AVLTree* rightRotate(AVLTree* y) {
-    AVLTree* x = y->left;
-    AVLTree* T2 = x->right;
+// Функции для обычного двоичного дерева
 
-    x->right = y;
-    y->left = T2;
+// Итеративно, чтобы глубокие деревья из больших файлов не переполняли стек вызовов
+template <typename Sink>
+void preorderBinaryTree(const BinaryTree* root, Sink& sink) {
+    if (root == nullptr) return;
 
-    y->height = max(getHeight(y->left), getHeight(y->right)) + 1;
-    x->height = max(getHeight(x->left), getHeight(x->right)) + 1;
+    TraversalBuffer<const BinaryTree*>& stack = traversalScratch<const BinaryTree*>();
+    stack.push(root);
+    while (!stack.isEmpty()) {
+        const BinaryTree* current = stack.pop();
+        sink(current->data);
 
-    return x;
+        if (current->right) stack.push(current->right);
+        if (current->left) stack.push(current->left);
+    }
 }
 
-AVLTree* leftRotate(AVLTree* x) {
-    AVLTree* y = x->right;
-    AVLTree* T2 = y->left;
+void dfsBinaryTree(BinaryTree* root) {
+    StreamSink sink(cout);
+    preorderBinaryTree(root, sink);
+}
 
-    y->left = x;
-    x->right = T2;
+void collectPreOrder(BinaryTree* root, vector<int>& elements) {
+    VectorSink sink{ elements };
+    preorderBinaryTree(root, sink);
+}
 
-    x->height = max(getHeight(x->left), getHeight(x->right)) + 1;
-    y->height = max(getHeight(y->left), getHeight(y->right)) + 1;
+// Вывод дерева боком: правое поддерево выше узла, отступ — 4 пробела на уровень. Узлы
+// глубже maxDepth не выводятся, у обрезанного узла с потомками ставится "...". Строки
+// копятся в буфере и уходят в поток кусками, без сброса после каждой строки
+const int PRINT_MAX_DEPTH = 16;
 
-    return y;
+void appendInt(string& out, int value) {
+    char digits[16];
+    out.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr - digits);
 }
 
-AVLTree* insertAVL(AVLTree* node, int key) {
-    if (!node) return new AVLTree(key);
+void appendNodeLabel(string& out, const BinaryTree* node) {
+    appendInt(out, node->data);
+}
 
-    if (key < node->data) {
-        node->left = insertAVL(node->left, key);
-    }
-    else if (key > node->data) {
-        node->right = insertAVL(node->right, key);
-    }
-    else {
-        return node;
-    }
+void appendNodeLabel(string& out, const AVLTree* node) {
+    appendInt(out, node->data);
+    out += " (h:";
+    appendInt(out, node->height);
+    out += ')';
+}
 
-    node->height = 1 + max(getHeight(node->left), getHeight(node->right));
+template <typename Node>
+struct RenderFrame {
+    const Node* node;
+    int depth;
+};
 
-    int balance = getBalance(node);
-    if (balance > 1 && key < node->left->data) {
-        return rightRotate(node);
-    }
+template <typename Node>
+void renderTree(const Node* root, ostream& out, int maxDepth) {
+    const size_t CHUNK = 1 << 16;
+    string chunk;
+    chunk.reserve(CHUNK + 256);
 
-    if (balance < -1 && key > node->right->data) {
-        return leftRotate(node);
+    TraversalBuffer<RenderFrame<Node>>& stack = traversalScratch<RenderFrame<Node>>();
+    const Node* current = root;
+    int depth = 0;
+    while (current || !stack.isEmpty()) {
+        while (current) {
+            stack.push(RenderFrame<Node>{ current, depth });
+            current = depth < maxDepth ? current->right : nullptr;
+            depth++;
+        }
+
+        RenderFrame<Node> frame = stack.pop();
+        chunk.append((size_t)frame.depth * 4, ' ');
+        chunk += "--> ";
+        appendNodeLabel(chunk, frame.node);
+        bool truncated = frame.depth >= maxDepth && (frame.node->left || frame.node->right);
+        if (truncated) chunk += " ...";
+        chunk += '\n';
+        if (chunk.size() >= CHUNK) {
+            out.write(chunk.data(), (streamsize)chunk.size());
+            chunk.clear();
+        }
+
+        current = frame.depth < maxDepth ? frame.node->left : nullptr;
+        depth = frame.depth + 1;
     }
+    out.write(chunk.data(), (streamsize)chunk.size());
+    out.flush();
+}
+
+void printBinaryTree(BinaryTree* root, int maxDepth = PRINT_MAX_DEPTH) {
+    renderTree(root, cout, maxDepth);
+}
+
+int countNodes(BinaryTree* root) {
+    return (int)summarizeTree(root, sharedPool()).count;
+}
+
+void deleteBinaryTree(BinaryTree* root) {
+    if (root == nullptr) return;
+
+    TraversalBuffer<BinaryTree*>& stack = traversalScratch<BinaryTree*>();
+    stack.push(root);
+    while (!stack.isEmpty()) {
+        BinaryTree* current = stack.pop();
+        if (current->left) stack.push(current->left);
+        if (current->right) stack.push(current->right);
+        binaryTreeArena.destroy(current);
+    }
+}
+
+// Функции для АВЛ дерева
+
+// Высота, баланс и повороты общие для всех видов АВЛ узлов: нужны только поля left, right и height
+template <typename Node>
+int getHeight(const Node* node) {
+    return node ? node->height : 0;
+}
+
+int max(int a, int b) {
+    return (a > b) ? a : b;
+}
+
+template <typename Node>
+int getBalance(const Node* node) {
+    return node ? getHeight(node->left) - getHeight(node->right) : 0;
+}
+
+// Поле узла, которое писатель меняет, пока читатели без блокировок его читают. Чтение и запись —
+// relaxed-атомарные операции: на x86 это те же обычные mov, но гонки данных нет. Для кода
+// балансировки поле выглядит как обычное значение
+template <typename T>
+class RelaxedField {
+public:
+    RelaxedField(T initial = T()) : value(initial) {}
+    RelaxedField(const RelaxedField& other) : value(other.load()) {}
+
+    RelaxedField& operator=(const RelaxedField& other) {
+        store(other.load());
+        return *this;
+    }
+
+    RelaxedField& operator=(T next) {
+        store(next);
+        return *this;
+    }
+
+    operator T() const {
+        return load();
+    }
+
+    T operator->() const {
+        return load();
+    }
+
+    T load() const {
+        return value.load(memory_order_relaxed);
+    }
+
+    void store(T next) {
+        value.store(next, memory_order_relaxed);
+    }
+
+private:
+    atomic<T> value;
+};
+
+// Шаблоны не выводят тип через преобразование, поэтому для ссылок-полей нужны свои перегрузки
+template <typename Node>
+int getHeight(const RelaxedField<Node*>& node) {
+    return getHeight(node.load());
+}
+
+template <typename Node>
+int getBalance(const RelaxedField<Node*>& node) {
+    return getBalance(node.load());
+}
+
+int getSize(const AVLTree* node) {
+    return node ? node->size : 0;
+}
+
+// Пересчёт дополнительных полей узла по потомкам: у AVLTree это размер поддерева
+template <typename Node>
+void updateSubtreeSize(Node*) {}
+
+void updateSubtreeSize(AVLTree* node) {
+    node->size = 1 + getSize(node->left) + getSize(node->right);
+}
+
+template <typename Node>
+void updateNode(Node* node) {
+    node->height = 1 + max(getHeight(node->left), getHeight(node->right));
+    updateSubtreeSize(node);
+}
+
+// Проверка одного узла по сохранённым полям потомков: ключ в границах (lo, hi), заданных
+// предками, высота, баланс и размер. Если это верно для всех узлов, верно и для всего дерева
+bool checkNodeAVL(const AVLTree* node, long long lo, long long hi) {
+    if (node->data <= lo || node->data >= hi) {
+        cout << "Нарушен порядок ключей в узле " << node->data << endl;
+        return false;
+    }
+    if (node->height != 1 + max(getHeight(node->left), getHeight(node->right))) {
+        cout << "Неверная высота в узле " << node->data << ": " << node->height << endl;
+        return false;
+    }
+    int balance = getBalance(node);
+    if (balance < -1 || balance > 1) {
+        cout << "Нарушен баланс в узле " << node->data << ": balance = " << balance << endl;
+        return false;
+    }
+    if (node->size != 1 + getSize(node->left) + getSize(node->right)) {
+        cout << "Неверный размер поддерева в узле " << node->data << ": " << node->size << endl;
+        return false;
+    }
+    return true;
+}
+
+struct ValidationFrame {
+    const AVLTree* node;
+    long long lo;
+    long long hi;
+};
+
+// Полная проверка всех узлов за O(n), без рекурсии
+bool isValidAVL(const AVLTree* root) {
+    if (!root) return true;
+
+    TraversalBuffer<ValidationFrame>& stack = traversalScratch<ValidationFrame>(getHeight(root) + 1);
+    stack.push(ValidationFrame{ root, LLONG_MIN, LLONG_MAX });
+    while (!stack.isEmpty()) {
+        ValidationFrame frame = stack.pop();
+        if (!checkNodeAVL(frame.node, frame.lo, frame.hi)) {
+            stack.clear();
+            return false;
+        }
+        if (frame.node->right) stack.push(ValidationFrame{ frame.node->right, frame.node->data, frame.hi });
+        if (frame.node->left) stack.push(ValidationFrame{ frame.node->left, frame.lo, frame.node->data });
+    }
+    return true;
+}
+
+// Проверка пути от корня к key вместе с потомками узлов пути: повороты при вставке
+// и удалении переставляют только узлы пути и их непосредственных потомков.
+// С pastKey путь не останавливается на key, а идёт к промежутку сразу за ним
+bool checkWalkAVL(const AVLTree* root, int key, bool pastKey = false) {
+    long long lo = LLONG_MIN;
+    long long hi = LLONG_MAX;
+    const AVLTree* node = root;
+    while (node) {
+        if (!checkNodeAVL(node, lo, hi)) return false;
+        if (node->left && !checkNodeAVL(node->left, lo, node->data)) return false;
+        if (node->right && !checkNodeAVL(node->right, node->data, hi)) return false;
+        if (key == node->data && !pastKey) return true;
+
+        if (key < node->data) {
+            hi = node->data;
+            node = node->left;
+        }
+        else {
+            lo = node->data;
+            node = node->right;
+        }
+    }
+    return true;
+}
+
+// Проверка после вставки или удаления key за O(log n). Удаление узла с двумя потомками
+// переносит на его место преемника s и вырезает s снизу: изменённый путь идёт от s
+// вправо и затем влево до конца, к промежутку сразу за s
+bool checkPathAVL(const AVLTree* root, int key) {
+    if (!checkWalkAVL(root, key)) return false;
+
+    const AVLTree* successor = nullptr;
+    for (const AVLTree* node = root; node;) {
+        if (key < node->data) {
+            successor = node;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
+    }
+    return !successor || checkWalkAVL(root, successor->data, true);
+}
+
+// В отладочной сборке после каждого изменения дерево проверяется целиком,
+// в релизной — только затронутый путь, а полная проверка доступна по запросу
+#ifndef NDEBUG
+const bool AVL_FULL_CHECKS = true;
+#else
+const bool AVL_FULL_CHECKS = false;
+#endif
+
+void checkBalance(AVLTree* root) {
+    bool balanced = isValidAVL(root);
+    cout << "Дерево " << (balanced ? "сбалансировано." : "несбалансировано.") << endl;
+}
+
+// Сводка по дереву: ключи сворачиваются параллельно по поддеревьям, уровни считаются
+// параллельным обходом в ширину
+template <typename Node>
+void printTreeSummary(const char* name, const Node* root) {
+    if (!root) {
+        cout << name << ": пусто" << endl;
+        return;
+    }
+    TreeSummary summary = summarizeTree(root, sharedPool());
+    int levels = parallelBreadthFirst(root, [](const Node*, size_t) {}, sharedPool());
+    cout << name << ": узлов " << summary.count << ", сумма " << summary.sum << ", минимум " << summary.minKey
+         << ", максимум " << summary.maxKey << ", уровней " << levels << endl;
+}
+
+void checkChangedPath(AVLTree* root, int key) {
+    bool balanced = checkPathAVL(root, key) && (!AVL_FULL_CHECKS || isValidAVL(root));
+    cout << "Дерево " << (balanced ? "сбалансировано." : "несбалансировано.") << endl;
+}
+
+template <typename Node>
+Node* rightRotate(Node* y) {
+    Node* x = y->left;
+    Node* T2 = x->right;
+    TREE_STAT(countStat(treeStats.rightRotations);)
+
+    x->right = y;
+    y->left = T2;
+
+    updateNode(y);
+    updateNode(x);
+
+    return x;
+}
+
+template <typename Node>
+Node* leftRotate(Node* x) {
+    Node* y = x->right;
+    Node* T2 = y->left;
+    TREE_STAT(countStat(treeStats.leftRotations);)
+
+    y->left = x;
+    x->right = T2;
+
+    updateNode(x);
+    updateNode(y);
+
+    return y;
+}
+
+template <typename Node>
+Node* rightRotate(const RelaxedField<Node*>& y) {
+    return rightRotate(y.load());
+}
+
+template <typename Node>
+Node* leftRotate(const RelaxedField<Node*>& x) {
+    return leftRotate(x.load());
+}
+
+// Высота АВЛ дерева из не более чем 2^32 узлов не превышает 1.44 * log2(n + 2) < 48
+const int AVL_MAX_HEIGHT = 64;
+
+// Пересчёт высоты узла и поворот, если баланс вышел за [-1, 1]; возвращает новый корень поддерева
+template <typename Node>
+Node* rebalanceAVL(Node* node) {
+    updateNode(node);
+    int balance = getBalance(node);
+
+    if (balance > 1) {
+        if (getBalance(node->left) < 0) {
+            TREE_STAT(countStat(treeStats.doubleRotations);)
+            node->left = leftRotate(node->left);
+        }
+        return rightRotate(node);
+    }
+    if (balance < -1) {
+        if (getBalance(node->right) > 0) {
+            TREE_STAT(countStat(treeStats.doubleRotations);)
+            node->right = rightRotate(node->right);
+        }
+        return leftRotate(node);
+    }
+    return node;
+}
+
+template <typename Node>
+void replaceChild(Node* parent, Node* oldChild, Node* newChild) {
+    if (parent->left == oldChild) parent->left = newChild;
+    else parent->right = newChild;
+}
+
+// Подъём по сохранённому пути от path[top] к корню. Как только высота поддерева
+// не изменилась, выше балансировать нечего, и у предков остаётся пересчитать только размеры
+template <typename Node>
+Node* rebalancePathAVL(Node* root, Node** path, int top) {
+    for (int i = top; i >= 0; i--) {
+        Node* current = path[i];
+        int oldHeight = current->height;
+        Node* subtree = rebalanceAVL(current);
+
+        if (i == 0) root = subtree;
+        else if (subtree != current) replaceChild(path[i - 1], current, subtree);
+
+        if (subtree->height == oldHeight) {
+            for (int j = i - 1; j >= 0; j--) updateSubtreeSize(path[j]);
+            break;
+        }
+    }
+    return root;
+}
+
+// Вставка для любых АВЛ узлов; новый узел даёт create(key)
+template <typename Node, typename Create>
+Node* insertNodeAVL(Node* root, int key, Create create) {
+    TREE_STAT(OperationTimer timer(OP_INSERT);)
+    Node* path[AVL_MAX_HEIGHT];
+    int depth = 0;
+
+    Node* node = root;
+    while (node) {
+        if (key == node->data) return root;
+        path[depth++] = node;
+        node = key < node->data ? node->left : node->right;
+    }
+
+    Node* created = create(key);
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    if (depth == 0) return created;
+
+    Node* parent = path[depth - 1];
+    if (key < parent->data) parent->left = created;
+    else parent->right = created;
+
+    return rebalancePathAVL(root, path, depth - 1);
+}
+
+AVLTree* insertAVL(AVLTree* root, int key, NodeArena<AVLTree>& arena = avlTreeArena) {
+    return insertNodeAVL(root, key, [&arena](int value) { return arena.create(value); });
+}
+
+AVLTree* searchAVL(AVLTree* root, int key) {
+    TREE_STAT(OperationTimer timer(OP_SEARCH);)
+    TREE_STAT(int pathLength = 0;)
+    while (root && root->data != key) {
+        TREE_STAT(pathLength++;)
+        root = key < root->data ? root->left : root->right;
+    }
+    TREE_STAT(recordSearchPath(pathLength + (root != nullptr));)
+    return root;
+}
+
+// Множество ключей, известное при сборке: ключи из параметров шаблона сортируются и
+// раскладываются в порядке Эйтцингера (дети элемента i — 2i и 2i + 1) ещё при компиляции,
+// поэтому при запуске ничего не строится. Поиск — спуск по неявному сбалансированному дереву
+// в массиве-константе, который компилятор может полностью встроить и развернуть
+struct StaticKeyNode {
+    int data;
+};
+
+// Элемент 0 не используется: так индексы детей считаются без поправок
+template <size_t N>
+struct StaticKeyArray {
+    int keys[N + 1];
+};
+
+template <size_t N>
+struct StaticKeyLayout {
+    StaticKeyNode nodes[N + 1];
+};
+
+template <size_t N>
+constexpr StaticKeyArray<N> sortStaticKeys(StaticKeyArray<N> sorted) {
+    for (size_t i = 1; i < N; i++) {
+        int key = sorted.keys[i];
+        size_t j = i;
+        for (; j > 0 && sorted.keys[j - 1] > key; j--) sorted.keys[j] = sorted.keys[j - 1];
+        sorted.keys[j] = key;
+    }
+    return sorted;
+}
+
+template <size_t N>
+constexpr bool hasDuplicateKeys(const StaticKeyArray<N>& sorted) {
+    for (size_t i = 1; i < N; i++) {
+        if (sorted.keys[i - 1] == sorted.keys[i]) return true;
+    }
+    return false;
+}
+
+// Симметричный обход неявного дерева 1..N раздаёт ключи по возрастанию
+template <size_t N>
+constexpr size_t fillEytzinger(const StaticKeyArray<N>& sorted, StaticKeyLayout<N>& result, size_t node, size_t next) {
+    if (node > N) return next;
+    next = fillEytzinger(sorted, result, 2 * node, next);
+    result.nodes[node].data = sorted.keys[next++];
+    return fillEytzinger(sorted, result, 2 * node + 1, next);
+}
+
+template <size_t N>
+constexpr StaticKeyLayout<N> buildEytzinger(const StaticKeyArray<N>& sorted) {
+    StaticKeyLayout<N> result = {};
+    fillEytzinger(sorted, result, 1, 0);
+    return result;
+}
+
+template <int... Keys>
+class StaticKeySet {
+public:
+    static constexpr size_t SIZE = sizeof...(Keys);
+
+    static constexpr const StaticKeyNode* search(int key) {
+        size_t i = 1;
+        while (i <= SIZE) {
+            if (layout.nodes[i].data == key) return &layout.nodes[i];
+            i = 2 * i + (layout.nodes[i].data < key);
+        }
+        return nullptr;
+    }
+
+    static constexpr bool contains(int key) {
+        return search(key) != nullptr;
+    }
+
+private:
+    static constexpr StaticKeyArray<SIZE> sorted = sortStaticKeys(StaticKeyArray<SIZE>{ { Keys..., 0 } });
+    static_assert(!hasDuplicateKeys(sorted), "ключи StaticKeySet должны быть различными");
+
+    static constexpr StaticKeyLayout<SIZE> layout = buildEytzinger(sorted);
+};
+
+// Тот же вызов, что и для дерева: searchAVL(set, key)->data
+template <int... Keys>
+constexpr const StaticKeyNode* searchAVL(const StaticKeySet<Keys...>&, int key) {
+    return StaticKeySet<Keys...>::search(key);
+}
+
+AVLTree* minValueNode(AVLTree* node) {
+    AVLTree* current = node;
+    while (current->left != nullptr)
+        current = current->left;
+    return current;
+}
+
+// Исключение узла node из дерева, path[0..depth-1] — путь от корня до его родителя.
+// Узел с двумя потомками заменяется самим узлом-преемником, а не копированием ключа,
+// поэтому указатели на остальные узлы дерева остаются действительными
+template <typename Node>
+Node* unlinkNodeAVL(Node* root, Node** path, int depth, Node* node) {
+    Node* parent = depth > 0 ? path[depth - 1] : nullptr;
+    Node* replacement;
+
+    if (node->left && node->right) {
+        int nodeIndex = depth;
+        path[depth++] = node;
+
+        Node* successor = node->right;
+        while (successor->left) {
+            path[depth++] = successor;
+            successor = successor->left;
+        }
+        replaceChild<Node>(path[depth - 1], successor, successor->right);
+
+        successor->left = node->left;
+        successor->right = node->right;
+        successor->height = node->height;
+        updateSubtreeSize(successor);
+        path[nodeIndex] = successor;
+        replacement = successor;
+    }
+    else {
+        replacement = node->left ? node->left : node->right;
+    }
+
+    if (parent) replaceChild(parent, node, replacement);
+    else root = replacement;
+
+    if (depth == 0) return root;
+    return rebalancePathAVL(root, path, depth - 1);
+}
+
+// Удаление для любых АВЛ узлов; исключённый узел передаётся в destroy(node)
+template <typename Node, typename Destroy>
+Node* deleteNodeAVL(Node* root, int key, Destroy destroy) {
+    TREE_STAT(OperationTimer timer(OP_DELETE);)
+    Node* path[AVL_MAX_HEIGHT];
+    int depth = 0;
+
+    Node* node = root;
+    while (node && node->data != key) {
+        path[depth++] = node;
+        node = key < node->data ? node->left : node->right;
+    }
+    if (!node) return root;
+
+    root = unlinkNodeAVL(root, path, depth, node);
+    destroy(node);
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    return root;
+}
+
+AVLTree* deleteAVL(AVLTree* root, int key, NodeArena<AVLTree>& arena = avlTreeArena) {
+    return deleteNodeAVL(root, key, [&arena](AVLTree* node) { arena.destroy(node); });
+}
+
+// Порядковые статистики за O(log n) по размерам поддеревьев
+
+// Число ключей меньше key
+int rankAVL(const AVLTree* root, int key) {
+    int rank = 0;
+    while (root) {
+        if (key <= root->data) {
+            root = root->left;
+        }
+        else {
+            rank += getSize(root->left) + 1;
+            root = root->right;
+        }
+    }
+    return rank;
+}
+
+// Число ключей не больше key
+int rankUpperAVL(const AVLTree* root, int key) {
+    int rank = 0;
+    while (root) {
+        if (key < root->data) {
+            root = root->left;
+        }
+        else {
+            rank += getSize(root->left) + 1;
+            root = root->right;
+        }
+    }
+    return rank;
+}
+
+// k-й по возрастанию узел, k с нуля; nullptr, если k вне [0, размер дерева)
+AVLTree* selectAVL(AVLTree* root, int k) {
+    while (root) {
+        int leftSize = getSize(root->left);
+        if (k < leftSize) {
+            root = root->left;
+        }
+        else if (k == leftSize) {
+            return root;
+        }
+        else {
+            k -= leftSize + 1;
+            root = root->right;
+        }
+    }
+    return nullptr;
+}
+
+// Число ключей в [lo, hi]
+int rangeCountAVL(const AVLTree* root, int lo, int hi) {
+    if (lo > hi) return 0;
+    return rankUpperAVL(root, hi) - rankAVL(root, lo);
+}
+
+// Упорядоченный обход АВЛ дерева без выделения памяти: итератор хранит путь от корня
+// до текущего узла во встроенном массиве. Переход к соседнему ключу — O(1) амортизированно,
+// поиск начальной позиции — O(log n). Любое изменение дерева делает итераторы недействительными
+class AVLTreeIterator {
+public:
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef int value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const int* pointer;
+    typedef const int& reference;
+
+    AVLTreeIterator() : root(nullptr), depth(0) {}
+
+    static AVLTreeIterator begin(const AVLTree* root) {
+        AVLTreeIterator it(root);
+        if (root) it.descendLeft(root);
+        return it;
+    }
+
+    static AVLTreeIterator end(const AVLTree* root) {
+        return AVLTreeIterator(root);
+    }
+
+    // Первый ключ не меньше key (strict = false) или больше key (strict = true). Путь
+    // обрезается до последнего подходящего узла: его предки на пути и есть его предки в дереве
+    static AVLTreeIterator bound(const AVLTree* root, int key, bool strict) {
+        AVLTreeIterator it(root);
+        int found = 0;
+        const AVLTree* node = root;
+        while (node) {
+            it.path[it.depth++] = node;
+            if (strict ? key < node->data : key <= node->data) {
+                found = it.depth;
+                node = node->left;
+            }
+            else {
+                node = node->right;
+            }
+        }
+        it.depth = found;
+        return it;
+    }
+
+    reference operator*() const {
+        return path[depth - 1]->data;
+    }
+
+    pointer operator->() const {
+        return &path[depth - 1]->data;
+    }
+
+    const AVLTree* node() const {
+        return depth ? path[depth - 1] : nullptr;
+    }
+
+    AVLTreeIterator& operator++() {
+        const AVLTree* current = path[depth - 1];
+        if (current->right) {
+            descendLeft(current->right);
+        }
+        else {
+            // Поднимаемся, пока выходим из правого поддерева
+            const AVLTree* child;
+            do {
+                child = path[--depth];
+            } while (depth > 0 && path[depth - 1]->right == child);
+        }
+        return *this;
+    }
+
+    AVLTreeIterator& operator--() {
+        if (depth == 0) {
+            descendRight(root);
+            return *this;
+        }
+        const AVLTree* current = path[depth - 1];
+        if (current->left) {
+            descendRight(current->left);
+        }
+        else {
+            const AVLTree* child;
+            do {
+                child = path[--depth];
+            } while (depth > 0 && path[depth - 1]->left == child);
+        }
+        return *this;
+    }
+
+    AVLTreeIterator operator++(int) {
+        AVLTreeIterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    AVLTreeIterator operator--(int) {
+        AVLTreeIterator old = *this;
+        --*this;
+        return old;
+    }
+
+    bool operator==(const AVLTreeIterator& other) const {
+        return node() == other.node();
+    }
+
+    bool operator!=(const AVLTreeIterator& other) const {
+        return node() != other.node();
+    }
+
+private:
+    explicit AVLTreeIterator(const AVLTree* root) : root(root), depth(0) {}
+
+    void descendLeft(const AVLTree* node) {
+        for (; node; node = node->left) path[depth++] = node;
+    }
+
+    void descendRight(const AVLTree* node) {
+        for (; node; node = node->right) path[depth++] = node;
+    }
+
+    const AVLTree* root;
+    int depth;
+    const AVLTree* path[AVL_MAX_HEIGHT];
+};
+
+// Полуинтервал итераторов для range-for
+struct AVLKeyRange {
+    AVLTreeIterator first;
+    AVLTreeIterator last;
+
+    AVLTreeIterator begin() const {
+        return first;
+    }
+
+    AVLTreeIterator end() const {
+        return last;
+    }
+};
+
+AVLTreeIterator lowerBoundAVL(const AVLTree* root, int key) {
+    return AVLTreeIterator::bound(root, key, false);
+}
+
+AVLTreeIterator upperBoundAVL(const AVLTree* root, int key) {
+    return AVLTreeIterator::bound(root, key, true);
+}
+
+// Все ключи по возрастанию
+AVLKeyRange keysAVL(const AVLTree* root) {
+    return AVLKeyRange{ AVLTreeIterator::begin(root), AVLTreeIterator::end(root) };
+}
+
+// Ключи из [lo, hi] по возрастанию
+AVLKeyRange rangeAVL(const AVLTree* root, int lo, int hi) {
+    if (lo > hi) return AVLKeyRange{ AVLTreeIterator::end(root), AVLTreeIterator::end(root) };
+    return AVLKeyRange{ lowerBoundAVL(root, lo), upperBoundAVL(root, hi) };
+}
+
+// Вызов visit для каждого ключа из [lo, hi] по возрастанию за O(log n + k); обход
+// прекращается досрочно, если visit вернёт false
+template <typename Visitor>
+void forEachInRangeAVL(const AVLTree* root, int lo, int hi, Visitor visit) {
+    AVLTreeIterator end = AVLTreeIterator::end(root);
+    for (AVLTreeIterator it = lowerBoundAVL(root, lo); it != end && *it <= hi; ++it) {
+        if (!visit(*it)) break;
+    }
+}
+
+void printAVLTree(AVLTree* root, int maxDepth = PRINT_MAX_DEPTH) {
+    renderTree(root, cout, maxDepth);
+}
+
+void deleteAVLTree(AVLTree* root) {
+    if (root == nullptr) return;
+
+    deleteAVLTree(root->left);
+    deleteAVLTree(root->right);
+    avlTreeArena.destroy(root);
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+}
+
+// Обобщённое АВЛ дерево: тип ключа, значения и порядок задаются параметрами шаблона.
+// Ключ и значение хранятся прямо в узле, узлы берутся из собственного пула дерева,
+// балансировка — те же повороты, что и у AVLTree
+template <typename Key, typename Value>
+struct AVLMapNode {
+    Key key;
+    Value value;
+    AVLMapNode* left;
+    AVLMapNode* right;
+    int height;
+
+    template <typename K, typename... Args>
+    AVLMapNode(K&& key, Args&&... args)
+        : key(forward<K>(key)), value(forward<Args>(args)...), left(nullptr), right(nullptr), height(1) {}
+};
+
+template <typename Key, typename Value, typename Compare = less<Key>>
+class AVLMap {
+public:
+    typedef AVLMapNode<Key, Value> Node;
+    // Небольшие тривиально копируемые ключи передаются по значению, остальные — по ссылке
+    typedef typename conditional<is_trivially_copyable<Key>::value && sizeof(Key) <= 2 * sizeof(void*), Key,
+                                 const Key&>::type KeyArg;
+
+    explicit AVLMap(const Compare& compare = Compare()) : root(nullptr), count(0), compare(compare) {}
+    AVLMap(const AVLMap&) = delete;
+    AVLMap& operator=(const AVLMap&) = delete;
+
+    ~AVLMap() {
+        clear();
+    }
+
+    // Вставка без замены существующего значения; возвращает значение по ключу и признак вставки
+    template <typename K, typename V>
+    pair<Value*, bool> insert(K&& key, V&& value) {
+        return emplace(forward<K>(key), forward<V>(value));
+    }
+
+    // Значение создаётся прямо в узле из args, только если ключа ещё нет
+    template <typename K, typename... Args>
+    pair<Value*, bool> emplace(K&& key, Args&&... args) {
+        Node* path[AVL_MAX_HEIGHT];
+        int depth = 0;
+
+        Node* node = root;
+        while (node) {
+            bool less = compare(key, node->key);
+            if (!less && !compare(node->key, key)) return make_pair(&node->value, false);
+            path[depth++] = node;
+            node = less ? node->left : node->right;
+        }
+
+        Node* created = arena.create(forward<K>(key), forward<Args>(args)...);
+        count++;
+        if (depth == 0) {
+            root = created;
+        }
+        else {
+            Node* parent = path[depth - 1];
+            if (compare(created->key, parent->key)) parent->left = created;
+            else parent->right = created;
+            root = rebalancePathAVL(root, path, depth - 1);
+        }
+        return make_pair(&created->value, true);
+    }
+
+    template <typename K, typename V>
+    pair<Value*, bool> insertOrAssign(K&& key, V&& value) {
+        pair<Value*, bool> result = emplace(forward<K>(key), forward<V>(value));
+        if (!result.second) *result.first = forward<V>(value);
+        return result;
+    }
+
+    Value* find(KeyArg key) const {
+        Node* node = root;
+        while (node) {
+            if (compare(key, node->key)) node = node->left;
+            else if (compare(node->key, key)) node = node->right;
+            else return &node->value;
+        }
+        return nullptr;
+    }
+
+    bool contains(KeyArg key) const {
+        return find(key) != nullptr;
+    }
+
+    bool erase(KeyArg key) {
+        Node* path[AVL_MAX_HEIGHT];
+        int depth = 0;
+
+        Node* node = root;
+        while (node) {
+            if (compare(key, node->key)) {
+                path[depth++] = node;
+                node = node->left;
+            }
+            else if (compare(node->key, key)) {
+                path[depth++] = node;
+                node = node->right;
+            }
+            else {
+                break;
+            }
+        }
+        if (!node) return false;
+
+        root = unlinkNodeAVL(root, path, depth, node);
+        arena.destroy(node);
+        count--;
+        return true;
+    }
+
+    // Для тривиально уничтожаемых ключей и значений пул освобождается целиком без обхода узлов
+    void clear() {
+        if (!is_trivially_destructible<Key>::value || !is_trivially_destructible<Value>::value) {
+            TraversalBuffer<Node*>& stack = traversalScratch<Node*>();
+            if (root) stack.push(root);
+            while (!stack.isEmpty()) {
+                Node* current = stack.pop();
+                if (current->left) stack.push(current->left);
+                if (current->right) stack.push(current->right);
+                arena.destroy(current);
+            }
+        }
+        arena.release();
+        root = nullptr;
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    int height() const {
+        return getHeight(root);
+    }
+
+    const Node* rootNode() const {
+        return root;
+    }
+
+private:
+    NodeArena<Node> arena;
+    Node* root;
+    size_t count;
+    Compare compare;
+};
+
+// Построение идеально сбалансированного АВЛ дерева из отсортированного массива без повторов за O(n)
+AVLTree* buildBalancedAVL(const vector<int>& sorted, int lo, int hi) {
+    if (lo > hi) return nullptr;
+
+    int mid = lo + (hi - lo) / 2;
+    AVLTree* node = avlTreeArena.create(sorted[mid]);
+    node->left = buildBalancedAVL(sorted, lo, mid - 1);
+    node->right = buildBalancedAVL(sorted, mid + 1, hi);
+    updateNode(node);
+    return node;
+}
+
+AVLTree* buildBalancedAVL(const vector<int>& sorted) {
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    return buildBalancedAVL(sorted, 0, (int)sorted.size() - 1);
+}
+
+// Сортировка и удаление повторов; уже строго возрастающий массив не сортируется повторно
+void sortAndDedup(vector<int>& elements) {
+    if (adjacent_find(elements.begin(), elements.end(), [](int a, int b) { return a >= b; }) == elements.end()) {
+        return;
+    }
+    sort(elements.begin(), elements.end());
+    elements.erase(unique(elements.begin(), elements.end()), elements.end());
+}
+
+// Обходы для АВЛ дерева: ключи передаются приёмнику
+template <typename Sink>
+void breadthFirstAVL(const AVLTree* root, Sink& sink) {
+    if (!root) return;
+
+    TraversalBuffer<const AVLTree*>& q = traversalScratch<const AVLTree*>();
+    q.enqueue(root);
+    while (!q.isEmpty()) {
+        const AVLTree* current = q.dequeue();
+        sink(current->data);
+
+        if (current->left) q.enqueue(current->left);
+        if (current->right) q.enqueue(current->right);
+    }
+}
+
+template <typename Sink>
+void preorderAVL(const AVLTree* root, Sink& sink) {
+    if (!root) return;
+
+    TraversalBuffer<const AVLTree*>& stack = traversalScratch<const AVLTree*>(getHeight(root) + 1);
+    stack.push(root);
+    while (!stack.isEmpty()) {
+        const AVLTree* current = stack.pop();
+        sink(current->data);
+
+        if (current->right) stack.push(current->right);
+        if (current->left) stack.push(current->left);
+    }
+}
+
+template <typename Sink>
+void inorderAVL(const AVLTree* root, Sink& sink) {
+    for (int key : keysAVL(root)) {
+        sink(key);
+    }
+}
+
+// Один стек глубиной в высоту дерева: узел выводится, когда из его правого поддерева
+// уже вернулись (или его нет)
+template <typename Sink>
+void postorderAVL(const AVLTree* root, Sink& sink) {
+    if (!root) return;
+
+    TraversalBuffer<const AVLTree*>& stack = traversalScratch<const AVLTree*>(getHeight(root) + 1);
+    const AVLTree* current = root;
+    const AVLTree* lastVisited = nullptr;
+    while (current || !stack.isEmpty()) {
+        while (current) {
+            stack.push(current);
+            current = current->left;
+        }
+
+        const AVLTree* top = stack.back();
+        if (top->right && top->right != lastVisited) {
+            current = top->right;
+        }
+        else {
+            sink(top->data);
+            lastVisited = stack.pop();
+        }
+    }
+}
+
+// Обходы Морриса: вместо стека временно используются пустые правые ссылки — правая ссылка
+// предшественника указывает на узел, к которому надо вернуться. Дополнительной памяти нет,
+// к концу обхода все ссылки восстановлены, но во время обхода дерево меняется, поэтому
+// параллельно его читать нельзя, а приёмник не должен обращаться к дереву
+template <typename Sink>
+void morrisInorderAVL(AVLTree* root, Sink& sink) {
+    AVLTree* current = root;
+    while (current) {
+        if (!current->left) {
+            sink(current->data);
+            current = current->right;
+            continue;
+        }
+
+        AVLTree* predecessor = current->left;
+        while (predecessor->right && predecessor->right != current) predecessor = predecessor->right;
+
+        if (!predecessor->right) {
+            predecessor->right = current;
+            current = current->left;
+        }
+        else {
+            predecessor->right = nullptr;
+            sink(current->data);
+            current = current->right;
+        }
+    }
+}
+
+template <typename Sink>
+void morrisPreorderAVL(AVLTree* root, Sink& sink) {
+    AVLTree* current = root;
+    while (current) {
+        if (!current->left) {
+            sink(current->data);
+            current = current->right;
+            continue;
+        }
+
+        AVLTree* predecessor = current->left;
+        while (predecessor->right && predecessor->right != current) predecessor = predecessor->right;
+
+        if (!predecessor->right) {
+            sink(current->data);
+            predecessor->right = current;
+            current = current->left;
+        }
+        else {
+            predecessor->right = nullptr;
+            current = current->right;
+        }
+    }
+}
+
+// Разворот цепочки правых ссылок от from до to; возвращает новое начало цепочки (to)
+AVLTree* reverseRightChainAVL(AVLTree* from, AVLTree* to) {
+    AVLTree* previous = nullptr;
+    AVLTree* current = from;
+    while (previous != to) {
+        AVLTree* next = current->right;
+        current->right = previous;
+        previous = current;
+        current = next;
+    }
+    return to;
+}
+
+// Обратный обход Морриса: при возврате по нити от предшественника правая граница левого
+// поддерева выводится снизу вверх; для этого цепочка разворачивается и затем
+// возвращается на место. Фиктивный корень с левым ребёнком root выводит последнюю границу
+template <typename Sink>
+void morrisPostorderAVL(AVLTree* root, Sink& sink) {
+    if (!root) return;
+
+    AVLTree dummy(0);
+    dummy.left = root;
+    AVLTree* current = &dummy;
+    while (current) {
+        if (!current->left) {
+            current = current->right;
+            continue;
+        }
+
+        AVLTree* predecessor = current->left;
+        while (predecessor->right && predecessor->right != current) predecessor = predecessor->right;
+
+        if (!predecessor->right) {
+            predecessor->right = current;
+            current = current->left;
+        }
+        else {
+            predecessor->right = nullptr;
+            AVLTree* node = reverseRightChainAVL(current->left, predecessor);
+            while (true) {
+                sink(node->data);
+                if (node == current->left) break;
+                node = node->right;
+            }
+            reverseRightChainAVL(predecessor, current->left);
+            current = current->right;
+        }
+    }
+}
+
+// Ключи в порядке обхода в ширину, как у breadthFirstAVL, но уровни обходятся параллельно
+void collectBreadthFirstParallel(const AVLTree* root, vector<int>& keys, WorkStealingPool& pool) {
+    size_t offset = keys.size();
+    keys.resize(offset + getSize(root));
+    int* out = keys.data() + offset;
+    parallelBreadthFirst(root, [out](const AVLTree* node, size_t index) { out[index] = node->data; }, pool);
+}
+
+template <typename Sink>
+void parallelBreadthFirstAVL(const AVLTree* root, Sink& sink) {
+    vector<int> keys;
+    collectBreadthFirstParallel(root, keys, sharedPool());
+    for (int key : keys) {
+        sink(key);
+    }
+}
+
+// Вид обхода по имени bfs/pre/in/post, с приставкой morris- — без стека, parallel-bfs —
+// по уровням в пуле потоков; false, если имя неизвестно
+template <typename Sink>
+bool traverseAVL(AVLTree* root, const string& kind, Sink& sink) {
+    if (kind == "bfs") breadthFirstAVL(root, sink);
+    else if (kind == "parallel-bfs") parallelBreadthFirstAVL(root, sink);
+    else if (kind == "pre") preorderAVL(root, sink);
+    else if (kind == "in") inorderAVL(root, sink);
+    else if (kind == "post") postorderAVL(root, sink);
+    else if (kind == "morris-pre") morrisPreorderAVL(root, sink);
+    else if (kind == "morris-in") morrisInorderAVL(root, sink);
+    else if (kind == "morris-post") morrisPostorderAVL(root, sink);
+    else return false;
+    return true;
+}
+
+// Подпись строки обхода; nullptr, если имя неизвестно
+const char* traversalTitleAVL(const string& kind) {
+    if (kind == "bfs" || kind == "parallel-bfs") return "Обход в ширину: ";
+    string order = kind.compare(0, 7, "morris-") == 0 ? kind.substr(7) : kind;
+    if (order == "pre") return "Прямой обход: ";
+    if (order == "in") return "Симметричный обход: ";
+    if (order == "post") return "Обратный обход: ";
+    return nullptr;
+}
+
+// Вывод обхода на консоль одной строкой с подписью
+void printTraversalAVL(AVLTree* root, const char* title, const string& kind) {
+    if (!root) return;
+
+    cout << title;
+    {
+        StreamSink sink(cout);
+        traverseAVL(root, kind, sink);
+    }
+    cout << endl;
+}
+
+void breadthFirstTraversalAVL(AVLTree* root) {
+    printTraversalAVL(root, "Обход в ширину: ", "bfs");
+}
+
+void preorderIterativeAVL(AVLTree* root) {
+    printTraversalAVL(root, "Прямой обход: ", "pre");
+}
+
+void inorderIterativeAVL(AVLTree* root) {
+    printTraversalAVL(root, "Симметричный обход: ", "in");
+}
+
+void postorderIterativeAVL(AVLTree* root) {
+    printTraversalAVL(root, "Обратный обход: ", "post");
+}
+
+// Выгрузка обхода в текстовый файл, ключи через пробел
+bool saveTraversalAVL(AVLTree* root, const string& kind, const string& filename) {
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        cout << "Ошибка открытия файла для записи!" << endl;
+        return false;
+    }
+    bool known;
+    {
+        BufferedWriter writer(file);
+        WriterSink sink{ writer };
+        known = traverseAVL(root, kind, sink);
+        writer.put('\n');
+    }
+    fclose(file);
+    if (!known) cout << "Неизвестный вид обхода!" << endl;
+    return known;
+}
+
+// Плоский снимок АВЛ дерева для поиска
+
+void collectInOrderAVL(AVLTree* root, vector<int>& elements) {
+    VectorSink sink{ elements };
+    inorderAVL(root, sink);
+}
+
+// Ключи хранятся в порядке Эйтцингера (потомки k — 2k и 2k+1, нумерация с 1) в массиве,
+// выровненном по кэш-линиям: 16 потомков узла на 4 уровня ниже лежат в одной линии
+class FlatAVLSnapshot {
+public:
+    FlatAVLSnapshot() : count(0), builtRoot(nullptr), builtVersion(0), built(false) {}
+
+    void build(AVLTree* root) {
+        vector<int> sorted;
+        collectInOrderAVL(root, sorted);
+
+        count = sorted.size();
+        lines.assign(count / KEYS_PER_LINE + 1, KeyLine());
+        size_t next = 0;
+        fill(sorted, next, 1);
+
+        builtRoot = root;
+        builtVersion = avlTreeVersion.load(memory_order_relaxed);
+        built = true;
+    }
+
+    bool isStale(AVLTree* root) const {
+        return !built || root != builtRoot || avlTreeVersion.load(memory_order_relaxed) != builtVersion;
+    }
+
+    // Спуск без ветвлений с упреждающей загрузкой линии на 4 уровня вперёд
+    bool contains(int key) const {
+        const int* keys = lines[0].keys;
+        size_t k = 1;
+        while (k <= count) {
+            prefetchRead(keys + k * KEYS_PER_LINE);
+            k = 2 * k + (keys[k] < key);
+        }
+        return decode(k, key);
+    }
+
+    // Пакетный поиск: ключи спускаются по уровням одновременно, так что промахи кэша разных
+    // ключей перекрываются. Все уровни, кроме последнего, заполнены, поэтому число шагов у всех
+    // ключей одинаково, а на последнем уровне отсутствующий узел считается шагом вправо —
+    // при декодировании он отбрасывается вместе с остальными младшими единицами
+    void containsBatch(const int* queries, size_t queryCount, bool* found) const {
+        if (count == 0) {
+            for (size_t i = 0; i < queryCount; i++) found[i] = false;
+            return;
+        }
+
+        int depth = 0;
+        while ((2ull << depth) <= count) depth++;
+
+        size_t i = 0;
+#if defined(__AVX2__)
+        const int* keys = lines[0].keys;
+        const int VECTORS = BATCH_GROUP / 8;
+        const __m256i limit = _mm256_set1_epi32((int)count + 1);
+        for (; i + BATCH_GROUP <= queryCount; i += BATCH_GROUP) {
+            __m256i x[VECTORS], k[VECTORS];
+            for (int v = 0; v < VECTORS; v++) {
+                x[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(queries + i + v * 8));
+                k[v] = _mm256_set1_epi32(1);
+            }
+            for (int level = 0; level < depth; level++) {
+                for (int v = 0; v < VECTORS; v++) {
+                    __m256i values = _mm256_i32gather_epi32(keys, k[v], 4);
+                    __m256i less = _mm256_cmpgt_epi32(x[v], values);
+                    k[v] = _mm256_sub_epi32(_mm256_add_epi32(k[v], k[v]), less);
+                }
+            }
+            for (int v = 0; v < VECTORS; v++) {
+                __m256i exists = _mm256_cmpgt_epi32(limit, k[v]);
+                __m256i values = _mm256_i32gather_epi32(keys, _mm256_and_si256(k[v], exists), 4);
+                __m256i less = _mm256_cmpgt_epi32(x[v], values);
+                __m256i right = _mm256_or_si256(less, _mm256_andnot_si256(exists, _mm256_set1_epi32(-1)));
+                k[v] = _mm256_sub_epi32(_mm256_add_epi32(k[v], k[v]), right);
+
+                alignas(32) unsigned int lanes[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), k[v]);
+                for (int lane = 0; lane < 8; lane++) {
+                    found[i + v * 8 + lane] = decode(lanes[lane], queries[i + v * 8 + lane]);
+                }
+            }
+        }
+#endif
+        for (; i < queryCount; i += BATCH_GROUP) {
+            size_t lanes = min((size_t)BATCH_GROUP, queryCount - i);
+            scalarBatch(queries + i, lanes, depth, found + i);
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+private:
+    static const int KEYS_PER_LINE = 16;
+    static const int BATCH_GROUP = 32;
+
+    void scalarBatch(const int* queries, size_t lanes, int depth, bool* found) const {
+        const int* keys = lines[0].keys;
+        size_t k[BATCH_GROUP];
+        for (size_t j = 0; j < lanes; j++) k[j] = 1;
+
+        for (int level = 0; level < depth; level++) {
+            for (size_t j = 0; j < lanes; j++) {
+                k[j] = 2 * k[j] + (keys[k[j]] < queries[j]);
+                prefetchRead(keys + k[j] * KEYS_PER_LINE);
+            }
+        }
+        for (size_t j = 0; j < lanes; j++) {
+            bool exists = k[j] <= count;
+            bool right = !exists || keys[exists ? k[j] : 0] < queries[j];
+            found[j] = decode(2 * k[j] + right, queries[j]);
+        }
+    }
+
+    bool decode(unsigned long long k, int key) const {
+        k >>= countTrailingZeros(~k) + 1;
+        return k != 0 && lines[0].keys[k] == key;
+    }
+
+    struct alignas(64) KeyLine {
+        int keys[KEYS_PER_LINE];
+    };
+
+    void fill(const vector<int>& sorted, size_t& next, size_t k) {
+        if (k > count) return;
+        int* keys = lines[0].keys;
+        fill(sorted, next, 2 * k);
+        keys[k] = sorted[next++];
+        fill(sorted, next, 2 * k + 1);
+    }
+
+    vector<KeyLine> lines;
+    size_t count;
+    AVLTree* builtRoot;
+    unsigned long long builtVersion;
+    bool built;
+};
+
+FlatAVLSnapshot avlSnapshot;
+
+// Поиск по снимку; после insertAVL/deleteAVL снимок перестраивается при первом обращении
+bool searchFlatAVL(AVLTree* root, int key) {
+    if (avlSnapshot.isStale(root)) {
+        avlSnapshot.build(root);
+    }
+    return avlSnapshot.contains(key);
+}
+
+void searchFlatAVLBatch(AVLTree* root, const int* keys, size_t count, bool* found) {
+    if (avlSnapshot.isStale(root)) {
+        avlSnapshot.build(root);
+    }
+    avlSnapshot.containsBatch(keys, count, found);
+}
+
+// Пакетный поиск по самому дереву: группа ключей спускается попеременно,
+// следующий узел каждого ключа подгружается, пока обрабатываются остальные
+void searchAVLBatch(AVLTree* root, const int* keys, size_t count, AVLTree** results) {
+    const size_t GROUP = 16;
+    AVLTree* cursor[GROUP];
+    // Как и в searchAVL, поиск в пустом дереве — путь нулевой длины
+    TREE_STAT(if (!root) recordSearchPath(0, count);)
+
+    for (size_t base = 0; base < count; base += GROUP) {
+        size_t lanes = min(GROUP, count - base);
+        for (size_t j = 0; j < lanes; j++) {
+            cursor[j] = root;
+            results[base + j] = nullptr;
+        }
+
+        size_t active = root ? lanes : 0;
+        TREE_STAT(int level = 1;)
+        while (active > 0) {
+            active = 0;
+            for (size_t j = 0; j < lanes; j++) {
+                AVLTree* node = cursor[j];
+                if (!node) continue;
+
+                int key = keys[base + j];
+                if (node->data == key) {
+                    TREE_STAT(recordSearchPath(level);)
+                    results[base + j] = node;
+                    cursor[j] = nullptr;
+                    continue;
+                }
+                node = key < node->data ? node->left : node->right;
+                cursor[j] = node;
+                if (node) {
+                    prefetchRead(node);
+                    active++;
+                }
+                TREE_STAT(if (!node) recordSearchPath(level);)
+            }
+            TREE_STAT(level++;)
+        }
+    }
+}
+
+// Потокобезопасное АВЛ дерево. Писатели выполняются по очереди под мьютексом, читатели не берут
+// блокировок: они запоминают счётчик версий (seqlock), ищут ключ и повторяют поиск, если за это
+// время писатель изменил дерево. Поля, которые читают читатели (ключ и ссылки на детей), —
+// RelaxedField, так что одновременные чтение и запись не являются гонкой данных. Память узлов
+// не возвращается до уничтожения дерева: удалённые узлы идут в собственный список свободных
+// узлов дерева и переиспользуются записью тех же полей, а читатель, попавший в такой узел,
+// отбрасывает результат при проверке версии
+struct ConcurrentAVLNode {
+    RelaxedField<int> data;
+    RelaxedField<ConcurrentAVLNode*> left;
+    RelaxedField<ConcurrentAVLNode*> right;
+    int height;
+
+    ConcurrentAVLNode(int val) : data(val), left(nullptr), right(nullptr), height(1) {}
+};
+
+class ConcurrentAVLTree {
+public:
+    typedef ConcurrentAVLNode Node;
+
+    ConcurrentAVLTree() : root(nullptr), freeNodes(nullptr), sequence(0), readRetries(0) {}
+    ConcurrentAVLTree(const ConcurrentAVLTree&) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&) = delete;
+
+    void insert(int key) {
+        lock_guard<mutex> lock(writerMutex);
+        beginWrite();
+        Node* updated = insertNodeAVL(root.load(memory_order_relaxed), key, [this](int value) { return createNode(value); });
+        root.store(updated, memory_order_relaxed);
+        endWrite();
+    }
+
+    void remove(int key) {
+        lock_guard<mutex> lock(writerMutex);
+        beginWrite();
+        Node* updated = deleteNodeAVL(root.load(memory_order_relaxed), key, [this](Node* node) { retireNode(node); });
+        root.store(updated, memory_order_relaxed);
+        endWrite();
+    }
+
+    bool contains(int key) const {
+        while (true) {
+            unsigned long long before = sequence.load(memory_order_acquire);
+            if (before & 1) {
+                this_thread::yield();
+                continue;
+            }
+
+            // Посреди поворота в дереве может временно возникнуть цикл, поэтому спуск ограничен
+            bool found = false;
+            bool complete = false;
+            const Node* node = root.load(memory_order_relaxed);
+            for (int step = 0; step <= AVL_MAX_HEIGHT; step++) {
+                if (!node) {
+                    complete = true;
+                    break;
+                }
+                int data = node->data;
+                if (data == key) {
+                    found = true;
+                    complete = true;
+                    break;
+                }
+                node = key < data ? node->left : node->right;
+            }
+
+            atomic_thread_fence(memory_order_acquire);
+            if (complete && sequence.load(memory_order_relaxed) == before) return found;
+            readRetries.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    // Только при отсутствии одновременных писателей: ключи по возрастанию в keys и проверка
+    // порядка, высот и баланса
+    bool isValid(vector<int>& keys) const {
+        return checkSubtree(root.load(memory_order_acquire), keys, 0) >= 0;
+    }
+
+    unsigned long long retries() const {
+        return readRetries.load(memory_order_relaxed);
+    }
+
+private:
+    void beginWrite() {
+        sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    void endWrite() {
+        sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    // Узел из списка свободных заполняется записью полей, а не конструктором: читатели могут
+    // ещё читать его поля
+    Node* createNode(int key) {
+        Node* node = freeNodes;
+        if (!node) return arena.create(key);
+        freeNodes = node->left;
+        node->data = key;
+        node->left = nullptr;
+        node->right = nullptr;
+        node->height = 1;
+        return node;
+    }
+
+    void retireNode(Node* node) {
+        node->left = freeNodes;
+        freeNodes = node;
+    }
+
+    // Высота поддерева или -1, если оно нарушает свойства АВЛ дерева
+    static int checkSubtree(const Node* node, vector<int>& keys, int depth) {
+        if (!node) return 0;
+        if (depth > AVL_MAX_HEIGHT) return -1;
+
+        int left = checkSubtree(node->left, keys, depth + 1);
+        if (left < 0 || (!keys.empty() && keys.back() >= node->data)) return -1;
+        keys.push_back(node->data);
+        int right = checkSubtree(node->right, keys, depth + 1);
+        if (right < 0 || left - right > 1 || right - left > 1 || node->height != 1 + max(left, right)) return -1;
+        return node->height;
+    }
+
+    NodeArena<Node> arena;
+    atomic<Node*> root;
+    // Писатели работают под writerMutex, поэтому список свободных узлов обычный
+    Node* freeNodes;
+    atomic<unsigned long long> sequence;
+    mutable atomic<unsigned long long> readRetries;
+    mutex writerMutex;
+};
+
+// Узел неизменяемой версии дерева. refs — число ссылок на узел из родителей и снимков
+struct PersistentAVLNode {
+    int data;
+    int height;
+    atomic<int> refs;
+    PersistentAVLNode* left;
+    PersistentAVLNode* right;
+    // Связь в списке узлов, ожидающих освобождения
+    PersistentAVLNode* retiredNext;
+
+    PersistentAVLNode(int val) : data(val), height(1), refs(1), left(nullptr), right(nullptr), retiredNext(nullptr) {}
+};
+
+// Персистентное АВЛ дерево с копированием пути. Изменение не трогает опубликованные узлы:
+// копируются только узлы на пути от корня (O(log n) узлов), остальные поддеревья общие
+// со старой версией. Снимок — это корень версии с увеличенным счётчиком ссылок, он берётся
+// за O(1) и не меняется, пока писатель продолжает работу. Узел, на который не осталось
+// ссылок, попадает в lock-free список и освобождается писателем: пул узлов не потокобезопасен
+class PersistentAVLTree {
+public:
+    typedef PersistentAVLNode Node;
+
+    class Snapshot {
+    public:
+        Snapshot() : tree(nullptr), root(nullptr) {}
+
+        Snapshot(const Snapshot& other) : tree(other.tree), root(other.root) {
+            if (root) root->refs.fetch_add(1, memory_order_relaxed);
+        }
+
+        Snapshot& operator=(Snapshot other) {
+            swap(tree, other.tree);
+            swap(root, other.root);
+            return *this;
+        }
+
+        ~Snapshot() {
+            if (root) tree->release(root);
+        }
+
+        bool contains(int key) const {
+            return PersistentAVLTree::contains(root, key);
+        }
+
+        int height() const {
+            return getHeight(root);
+        }
+
+        const Node* rootNode() const {
+            return root;
+        }
+
+    private:
+        friend class PersistentAVLTree;
+        Snapshot(const PersistentAVLTree* tree, Node* root) : tree(tree), root(root) {}
+
+        const PersistentAVLTree* tree;
+        Node* root;
+    };
+
+    PersistentAVLTree() : root(nullptr), retired(nullptr), copiedNodes(0), destroyedNodes(0) {}
+    PersistentAVLTree(const PersistentAVLTree&) = delete;
+    PersistentAVLTree& operator=(const PersistentAVLTree&) = delete;
+
+    // Все снимки должны быть уничтожены раньше дерева
+    ~PersistentAVLTree() {
+        if (root) release(root);
+        reclaim();
+    }
+
+    Snapshot snapshot() const {
+        lock_guard<mutex> lock(rootMutex);
+        if (root) root->refs.fetch_add(1, memory_order_relaxed);
+        return Snapshot(this, root);
+    }
+
+    bool insert(int key) {
+        lock_guard<mutex> lock(writerMutex);
+        reclaim();
+        if (contains(root, key)) return false;
+
+        Node* path[AVL_MAX_HEIGHT];
+        int depth = 0;
+        Node* newRoot = root ? copyNode(root) : nullptr;
+        Node** link = &newRoot;
+        while (*link) {
+            Node* node = *link;
+            path[depth++] = node;
+            link = key < node->data ? &node->left : &node->right;
+            if (*link) *link = ownChild(*link);
+        }
+        *link = arena.create(key);
+
+        publish(rebalancePath(newRoot, path, depth - 1));
+        return true;
+    }
+
+    bool remove(int key) {
+        lock_guard<mutex> lock(writerMutex);
+        reclaim();
+        if (!contains(root, key)) return false;
+
+        Node* path[AVL_MAX_HEIGHT];
+        int depth = 0;
+        Node* newRoot = copyNode(root);
+        Node** link = &newRoot;
+        while ((*link)->data != key) {
+            Node* node = *link;
+            path[depth++] = node;
+            link = key < node->data ? &node->left : &node->right;
+            *link = ownChild(*link);
+        }
+
+        // Узел с двумя потомками принимает ключ преемника, удаляется узел преемника.
+        // Перезаписывать ключ можно: все узлы на пути — свежие копии
+        Node* target = *link;
+        if (target->left && target->right) {
+            path[depth++] = target;
+            link = &target->right;
+            *link = ownChild(*link);
+            while ((*link)->left) {
+                path[depth++] = *link;
+                link = &(*link)->left;
+                *link = ownChild(*link);
+            }
+            target->data = (*link)->data;
+        }
+
+        // Ссылка на единственного потомка переходит к родителю, сам удаляемый узел — свежая копия
+        Node* removed = *link;
+        *link = removed->left ? removed->left : removed->right;
+        arena.destroy(removed);
+        destroyedNodes++;
+
+        publish(rebalancePath(newRoot, path, depth - 1));
+        return true;
+    }
+
+    // Сколько узлов скопировано при изменениях за всё время
+    size_t copies() const {
+        return copiedNodes;
+    }
+
+    size_t liveNodes() {
+        lock_guard<mutex> lock(writerMutex);
+        reclaim();
+        return arena.createdNodes() - destroyedNodes;
+    }
+
+private:
+    static bool contains(const Node* node, int key) {
+        while (node) {
+            if (key == node->data) return true;
+            node = key < node->data ? node->left : node->right;
+        }
+        return false;
+    }
+
+    // Копия узла, ссылающаяся на тех же потомков; исходный узел остаётся в старых версиях
+    Node* copyNode(const Node* node) {
+        Node* copy = arena.create(node->data);
+        copy->height = node->height;
+        copy->left = node->left;
+        copy->right = node->right;
+        if (copy->left) copy->left->refs.fetch_add(1, memory_order_relaxed);
+        if (copy->right) copy->right->refs.fetch_add(1, memory_order_relaxed);
+        copiedNodes++;
+        return copy;
+    }
+
+    // Потомок свежей копии, который можно менять. Пока жива текущая версия, на любой её
+    // узел, достижимый из копии, ссылаются минимум двое, поэтому ровно одна ссылка бывает
+    // только у узлов, созданных в этом же изменении
+    Node* ownChild(Node* child) {
+        if (child->refs.load(memory_order_relaxed) == 1) return child;
+        Node* copy = copyNode(child);
+        release(child);
+        return copy;
+    }
+
+    // Перед поворотом копируются и задействованные в нём потомки: при удалении перевешивает
+    // поддерево, не лежащее на скопированном пути
+    Node* rebalanceOwned(Node* node) {
+        int balance = getHeight(node->left) - getHeight(node->right);
+        if (balance > 1) {
+            node->left = ownChild(node->left);
+            if (getBalance(node->left) < 0) node->left->right = ownChild(node->left->right);
+        }
+        else if (balance < -1) {
+            node->right = ownChild(node->right);
+            if (getBalance(node->right) > 0) node->right->left = ownChild(node->right->left);
+        }
+        return rebalanceAVL(node);
+    }
+
+    Node* rebalancePath(Node* newRoot, Node** path, int top) {
+        for (int i = top; i >= 0; i--) {
+            Node* subtree = rebalanceOwned(path[i]);
+            if (i > 0) replaceChild(path[i - 1], path[i], subtree);
+            else newRoot = subtree;
+        }
+        return newRoot;
+    }
+
+    void publish(Node* newRoot) {
+        Node* old;
+        {
+            lock_guard<mutex> lock(rootMutex);
+            old = root;
+            root = newRoot;
+        }
+        if (old) release(old);
+        reclaim();
+    }
+
+    // Вызывается из любого потока: узел без ссылок только ставится в очередь на освобождение
+    void release(Node* node) const {
+        if (node->refs.fetch_sub(1, memory_order_acq_rel) != 1) return;
+        Node* head = retired.load(memory_order_relaxed);
+        do {
+            node->retiredNext = head;
+        } while (!retired.compare_exchange_weak(head, node, memory_order_release, memory_order_relaxed));
+    }
+
+    // Только под writerMutex или в деструкторе: освобождение очереди с каскадом по потомкам
+    void reclaim() {
+        Node* list = retired.exchange(nullptr, memory_order_acquire);
+        while (list) {
+            Node* node = list;
+            list = node->retiredNext;
+            Node* children[2] = { node->left, node->right };
+            for (Node* child : children) {
+                if (child && child->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+                    child->retiredNext = list;
+                    list = child;
+                }
+            }
+            arena.destroy(node);
+            destroyedNodes++;
+        }
+    }
+
+    NodeArena<Node> arena;
+    Node* root;
+    mutable atomic<Node*> retired;
+    size_t copiedNodes;
+    size_t destroyedNodes;
+    mutable mutex rootMutex;
+    mutex writerMutex;
+};
+
+// Компактный узел: потомки — 32-битные индексы в общем массиве узлов, 0 — нет потомка.
+// Вместо высоты хранится показатель баланса h(right) - h(left) + 1 в двух старших битах
+// поля правого потомка, так что узел занимает 12 байт и в кэш-линию помещается пять узлов
+struct CompactAVLNode {
+    int data;
+    uint32_t left;
+    uint32_t rightAndBalance;
+};
+
+// АВЛ дерево на компактных узлах. Узлы лежат подряд в одном векторе, освобождённые
+// переиспользуются через список свободных. Индексов хватает на 2^30 - 1 узлов. Высоты
+// не хранятся, поэтому вставка и удаление ведут баланс узлов напрямую, а повороты
+// пересчитывают его по формулам вместо getHeight
+class CompactAVLTree {
+public:
+    CompactAVLTree() : root(0), freeList(0), count(0) {
+        nodes.resize(1);
+    }
+
+    void reserve(size_t capacity) {
+        nodes.reserve(capacity + 1);
+    }
+
+    bool insert(int key) {
+        uint32_t path[AVL_MAX_HEIGHT];
+        bool wentRight[AVL_MAX_HEIGHT];
+        int depth = 0;
+
+        uint32_t node = root;
+        while (node) {
+            int data = nodes[node].data;
+            if (key == data) return false;
+            path[depth] = node;
+            wentRight[depth] = key > data;
+            node = wentRight[depth] ? right(node) : nodes[node].left;
+            depth++;
+        }
+
+        uint32_t created = allocate(key);
+        if (!created) {
+            cout << "Ошибка: в компактном дереве не больше " << INDEX_MASK << " узлов!" << endl;
+            return false;
+        }
+        if (depth == 0) {
+            root = created;
+            return true;
+        }
+        setChild(path[depth - 1], wentRight[depth - 1], created);
+
+        // Подъём, пока высота поддерева растёт; после поворота она возвращается к прежней
+        for (int i = depth - 1; i >= 0; i--) {
+            uint32_t ancestor = path[i];
+            int balanceAfter = balance(ancestor) + (wentRight[i] ? 1 : -1);
+            if (balanceAfter == 0) {
+                setBalance(ancestor, 0);
+                break;
+            }
+            if (balanceAfter == 1 || balanceAfter == -1) {
+                setBalance(ancestor, balanceAfter);
+                continue;
+            }
+            bool shorter;
+            uint32_t top = rebalance(ancestor, balanceAfter, shorter);
+            if (i == 0) root = top;
+            else setChild(path[i - 1], wentRight[i - 1], top);
+            break;
+        }
+        return true;
+    }
+
+    bool remove(int key) {
+        uint32_t path[AVL_MAX_HEIGHT];
+        bool wentRight[AVL_MAX_HEIGHT];
+        int depth = 0;
+
+        uint32_t node = root;
+        while (node && nodes[node].data != key) {
+            path[depth] = node;
+            wentRight[depth] = key > nodes[node].data;
+            node = wentRight[depth] ? right(node) : nodes[node].left;
+            depth++;
+        }
+        if (!node) return false;
+
+        // Внешних ссылок на узлы нет, поэтому узел с двумя потомками просто получает ключ
+        // преемника, а удаляется узел преемника
+        if (nodes[node].left && right(node)) {
+            path[depth] = node;
+            wentRight[depth] = true;
+            depth++;
+            uint32_t successor = right(node);
+            while (nodes[successor].left) {
+                path[depth] = successor;
+                wentRight[depth] = false;
+                depth++;
+                successor = nodes[successor].left;
+            }
+            nodes[node].data = nodes[successor].data;
+            node = successor;
+        }
+
+        uint32_t child = nodes[node].left ? nodes[node].left : right(node);
+        if (depth == 0) root = child;
+        else setChild(path[depth - 1], wentRight[depth - 1], child);
+        release(node);
+
+        // Подъём, пока высота поддерева уменьшается
+        for (int i = depth - 1; i >= 0; i--) {
+            uint32_t ancestor = path[i];
+            int balanceAfter = balance(ancestor) + (wentRight[i] ? -1 : 1);
+            if (balanceAfter == 1 || balanceAfter == -1) {
+                setBalance(ancestor, balanceAfter);
+                break;
+            }
+            if (balanceAfter == 0) {
+                setBalance(ancestor, 0);
+                continue;
+            }
+            bool shorter;
+            uint32_t top = rebalance(ancestor, balanceAfter, shorter);
+            if (i == 0) root = top;
+            else setChild(path[i - 1], wentRight[i - 1], top);
+            if (!shorter) break;
+        }
+        return true;
+    }
+
+    // Индекс потомка нужно ещё превратить в адрес, и аппаратная предвыборка по указателям
+    // здесь не срабатывает, поэтому оба потомка подгружаются заранее, пока идёт сравнение
+    bool contains(int key) const {
+        const CompactAVLNode* base = nodes.data();
+        uint32_t node = root;
+        while (node) {
+            prefetchRead(base + base[node].left);
+            prefetchRead(base + right(node));
+            int data = base[node].data;
+            if (key < data) node = base[node].left;
+            else if (key > data) node = right(node);
+            else return true;
+        }
+        return false;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Спуск по более высокому потомку, O(log n)
+    int height() const {
+        int result = 0;
+        for (uint32_t node = root; node; result++) {
+            node = balance(node) > 0 ? right(node) : nodes[node].left;
+        }
+        return result;
+    }
+
+    size_t memoryBytes() const {
+        return nodes.capacity() * sizeof(CompactAVLNode);
+    }
+
+    // Полная проверка порядка ключей и сохранённых балансов
+    bool isValid() const {
+        return checkSubtree(root, LLONG_MIN, LLONG_MAX) >= 0;
+    }
+
+private:
+    static const uint32_t INDEX_MASK = (1u << 30) - 1;
+
+    uint32_t right(uint32_t node) const {
+        return nodes[node].rightAndBalance & INDEX_MASK;
+    }
+
+    void setRight(uint32_t node, uint32_t child) {
+        nodes[node].rightAndBalance = (nodes[node].rightAndBalance & ~INDEX_MASK) | child;
+    }
+
+    void setChild(uint32_t node, bool isRight, uint32_t child) {
+        if (isRight) setRight(node, child);
+        else nodes[node].left = child;
+    }
+
+    int balance(uint32_t node) const {
+        return (int)(nodes[node].rightAndBalance >> 30) - 1;
+    }
+
+    void setBalance(uint32_t node, int balance) {
+        nodes[node].rightAndBalance = (nodes[node].rightAndBalance & INDEX_MASK) | ((uint32_t)(balance + 1) << 30);
+    }
+
+    // Индекс нового узла или 0, если индексы закончились: больший индекс залез бы в биты баланса
+    uint32_t allocate(int key) {
+        uint32_t node = freeList;
+        if (node) {
+            freeList = nodes[node].left;
+        }
+        else {
+            if (nodes.size() > INDEX_MASK) return 0;
+            node = (uint32_t)nodes.size();
+            nodes.emplace_back();
+        }
+        nodes[node].data = key;
+        nodes[node].left = 0;
+        nodes[node].rightAndBalance = 1u << 30;
+        count++;
+        return node;
+    }
+
+    void release(uint32_t node) {
+        nodes[node].left = freeList;
+        freeList = node;
+        count--;
+    }
+
+    uint32_t rotateLeft(uint32_t x) {
+        uint32_t z = right(x);
+        setRight(x, nodes[z].left);
+        nodes[z].left = x;
+        return z;
+    }
+
+    uint32_t rotateRight(uint32_t x) {
+        uint32_t z = nodes[x].left;
+        nodes[x].left = right(z);
+        setRight(z, x);
+        return z;
+    }
+
+    // Поворот узла x с балансом ±2: такой баланс не помещается в два бита и передаётся
+    // отдельно. shorter — стало ли поддерево ниже, чем было до нарушения баланса
+    uint32_t rebalance(uint32_t x, int xBalance, bool& shorter) {
+        if (xBalance > 0) {
+            uint32_t z = right(x);
+            int zBalance = balance(z);
+            if (zBalance >= 0) {
+                uint32_t top = rotateLeft(x);
+                setBalance(x, zBalance == 0 ? 1 : 0);
+                setBalance(z, zBalance == 0 ? -1 : 0);
+                shorter = zBalance != 0;
+                return top;
+            }
+            uint32_t y = nodes[z].left;
+            int yBalance = balance(y);
+            setRight(x, rotateRight(z));
+            uint32_t top = rotateLeft(x);
+            setBalance(x, yBalance > 0 ? -1 : 0);
+            setBalance(z, yBalance < 0 ? 1 : 0);
+            setBalance(y, 0);
+            shorter = true;
+            return top;
+        }
+
+        uint32_t z = nodes[x].left;
+        int zBalance = balance(z);
+        if (zBalance <= 0) {
+            uint32_t top = rotateRight(x);
+            setBalance(x, zBalance == 0 ? -1 : 0);
+            setBalance(z, zBalance == 0 ? 1 : 0);
+            shorter = zBalance != 0;
+            return top;
+        }
+        uint32_t y = right(z);
+        int yBalance = balance(y);
+        nodes[x].left = rotateLeft(z);
+        uint32_t top = rotateRight(x);
+        setBalance(x, yBalance < 0 ? 1 : 0);
+        setBalance(z, yBalance > 0 ? -1 : 0);
+        setBalance(y, 0);
+        shorter = true;
+        return top;
+    }
+
+    // Высота поддерева или -1 при нарушении; глубина рекурсии ограничена высотой дерева
+    int checkSubtree(uint32_t node, long long lo, long long hi) const {
+        if (!node) return 0;
+        int data = nodes[node].data;
+        if (data <= lo || data >= hi) return -1;
+        int leftHeight = checkSubtree(nodes[node].left, lo, data);
+        int rightHeight = checkSubtree(right(node), data, hi);
+        if (leftHeight < 0 || rightHeight < 0 || rightHeight - leftHeight != balance(node)) return -1;
+        return 1 + max(leftHeight, rightHeight);
+    }
+
+    vector<CompactAVLNode> nodes;
+    uint32_t root;
+    uint32_t freeList;
+    size_t count;
+};
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Разбор целого числа прямо в тексте. Возвращает nullptr или сообщение об ошибке,
+// при ошибке pos указывает на её место
+const char* parseIntAt(const char* text, size_t length, size_t& pos, int& value) {
+    size_t numberStart = pos;
+    bool isNegative = pos < length && text[pos] == '-';
+    if (isNegative) pos++;
+    if (pos >= length || !isDigit(text[pos])) return "ожидалось число";
+
+    long long limit = isNegative ? -(long long)INT_MIN : INT_MAX;
+    long long num = 0;
+    while (pos < length && isDigit(text[pos])) {
+        num = num * 10 + (text[pos] - '0');
+        if (num > limit) {
+            pos = numberStart;
+            return "число вне диапазона int";
+        }
+        pos++;
+    }
+    value = (int)(isNegative ? -num : num);
+    return nullptr;
+}
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), length(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        fd = -1;
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const string& filename) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+        if (length == 0) return true;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close();
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length == 0) return true;
+
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close();
+            return false;
+        }
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+#endif
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<char*>(data), length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        length = 0;
+    }
+
+    const char* begin() const { return data; }
+    size_t size() const { return length; }
+
+private:
+    const char* data;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+struct ParseError {
+    size_t offset;
+    const char* message;
+
+    ParseError() : offset(0), message(nullptr) {}
+};
+
+struct ParseFrame {
+    BinaryTree* node;
+    int children;
+};
+
+// Разбор скобочной записи "(число левое правое)" за один проход без рекурсии и временных строк.
+// Разбирает одно дерево начиная с pos, оставляет pos за закрывающей скобкой.
+// Пустое поддерево записывается как "()" или опускается, переводы строк допустимы как пробелы
+BinaryTree* parseBinaryTree(const char* text, size_t length, size_t& pos, ParseError& error) {
+    error = ParseError();
+    while (pos < length && isSpace(text[pos])) pos++;
+
+    if (pos >= length || text[pos] != '(') {
+        error.offset = pos;
+        error.message = "ожидалась '('";
+        return nullptr;
+    }
+    pos++;
+
+    TraversalBuffer<ParseFrame>& frames = traversalScratch<ParseFrame>();
+    BinaryTree* root = nullptr;
+    BinaryTree** slot = &root;
+    bool afterOpen = true;
+
+    while (true) {
+        while (pos < length && isSpace(text[pos])) pos++;
+        if (pos >= length) {
+            error.offset = pos;
+            error.message = "неожиданный конец записи";
+            break;
+        }
+
+        char c = text[pos];
+        if (afterOpen) {
+            afterOpen = false;
+            if (c == ')') {
+                pos++;
+                if (frames.isEmpty()) return root;
+                continue;
+            }
+
+            int num;
+            const char* message = parseIntAt(text, length, pos, num);
+            if (message) {
+                error.offset = pos;
+                error.message = message;
+                break;
+            }
+
+            BinaryTree* node = binaryTreeArena.create(num);
+            *slot = node;
+            frames.push({ node, 0 });
+            TREE_STAT(recordParseDepth(frames.count);)
+        }
+        else if (c == '(') {
+            ParseFrame& frame = frames.back();
+            if (frame.children == 2) {
+                error.offset = pos;
+                error.message = "у узла больше двух потомков";
+                break;
+            }
+            slot = frame.children == 0 ? &frame.node->left : &frame.node->right;
+            frame.children++;
+            afterOpen = true;
+            pos++;
+        }
+        else if (c == ')') {
+            pos++;
+            frames.pop();
+            if (frames.isEmpty()) return root;
+        }
+        else {
+            error.offset = pos;
+            error.message = "недопустимый символ";
+            break;
+        }
+    }
+
+    deleteBinaryTree(root);
+    return nullptr;
+}
+
+BinaryTree* parseBinaryTreeFromString(const string& str, size_t& pos) {
+    ParseError error;
+    return parseBinaryTree(str.data(), str.length(), pos, error);
+}
+
+BinaryTree* createBinaryTreeFromFile(const string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        cout << "Ошибка открытия файла!" << endl;
+        return nullptr;
+    }
+
+    const char* text = file.begin();
+    size_t length = file.size();
+    if (length <= 200) {
+        cout << "Прочитанная строка из файла: " << string(text ? text : "", length) << endl;
+    }
+    else {
+        cout << "Размер файла: " << length << " байт" << endl;
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t pos = 0;
+    ParseError error;
+    BinaryTree* root = parseBinaryTree(text, length, pos, error);
+
+    if (!error.message) {
+        while (pos < length && isSpace(text[pos])) pos++;
+        if (pos < length) {
+            deleteBinaryTree(root);
+            root = nullptr;
+            error.offset = pos;
+            error.message = "лишние символы после дерева";
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (error.message) {
+        cout << "Ошибка: неверный формат скобочной записи на смещении " << error.offset << ": " << error.message << endl;
+        return nullptr;
+    }
+
+    if (root == nullptr) {
+        cout << "Ошибка при парсинге дерева!" << endl;
+    }
+    else {
+        cout << "Двоичное дерево успешно создано!" << endl;
+        cout << "Разобрано " << length / 1048576.0 << " МБ за " << seconds * 1000 << " мс ("
+             << (seconds > 0 ? length / 1048576.0 / seconds : 0) << " МБ/с)" << endl;
+    }
+
+    return root;
+}
+
+// Параллельное построение АВЛ дерева из двоичного
+
+// Прямой обход, в котором поддеревья глубже splitDepth собираются параллельно в отдельные
+// массивы, а затем копируются на свои места, так что порядок совпадает с collectPreOrder
+void collectPreOrderParallel(BinaryTree* root, vector<int>& elements, WorkStealingPool& pool) {
+    if (!root) return;
+
+    int splitDepth = parallelSplitDepth(pool);
+
+    // План верхней части дерева: ключ узла или номер поддерева, собираемого отдельно
+    struct PlanItem {
+        int key;
+        int part;
+    };
+    struct Pending {
+        BinaryTree* node;
+        int depth;
+    };
+    vector<PlanItem> plan;
+    vector<BinaryTree*> subtrees;
+    TraversalBuffer<Pending>& stack = traversalScratch<Pending>();
+    stack.push({ root, 0 });
+    while (!stack.isEmpty()) {
+        Pending current = stack.pop();
+        if (current.depth == splitDepth) {
+            plan.push_back({ 0, (int)subtrees.size() });
+            subtrees.push_back(current.node);
+            continue;
+        }
+        plan.push_back({ current.node->data, -1 });
+        if (current.node->right) stack.push({ current.node->right, current.depth + 1 });
+        if (current.node->left) stack.push({ current.node->left, current.depth + 1 });
+    }
+
+    vector<vector<int>> parts(subtrees.size());
+    {
+        TaskGroup group(pool);
+        for (size_t i = 0; i < subtrees.size(); i++) {
+            group.run([&, i]() { collectPreOrder(subtrees[i], parts[i]); });
+        }
+        group.wait();
+    }
+
+    size_t total = elements.size();
+    for (const PlanItem& item : plan) {
+        total += item.part < 0 ? 1 : parts[item.part].size();
+    }
+    size_t offset = elements.size();
+    elements.resize(total);
+
+    TaskGroup group(pool);
+    for (const PlanItem& item : plan) {
+        if (item.part < 0) {
+            elements[offset++] = item.key;
+            continue;
+        }
+        const vector<int>& part = parts[item.part];
+        int* destination = elements.data() + offset;
+        group.run([&part, destination]() { copy(part.begin(), part.end(), destination); });
+        offset += part.size();
+    }
+    group.wait();
+}
+
+const size_t PARALLEL_SORT_GRAIN = 1 << 15;
+
+// Слияние двух отсортированных массивов: середина большего ищется в меньшем двоичным поиском,
+// и две половины сливаются параллельно
+void parallelMerge(const int* a, size_t countA, const int* b, size_t countB, int* out, WorkStealingPool& pool) {
+    if (countA < countB) {
+        swap(a, b);
+        swap(countA, countB);
+    }
+    if (countA + countB <= PARALLEL_SORT_GRAIN) {
+        merge(a, a + countA, b, b + countB, out);
+        return;
+    }
+
+    size_t midA = countA / 2;
+    size_t midB = lower_bound(b, b + countB, a[midA]) - b;
+    out[midA + midB] = a[midA];
+
+    TaskGroup group(pool);
+    group.run([=, &pool]() { parallelMerge(a, midA, b, midB, out, pool); });
+    parallelMerge(a + midA + 1, countA - midA - 1, b + midB, countB - midB, out + midA + midB + 1, pool);
+    group.wait();
+}
+
+// Сортировка слиянием с попеременным использованием data и buffer; результат в buffer, если intoBuffer
+void parallelSortRange(int* data, int* buffer, size_t count, bool intoBuffer, WorkStealingPool& pool) {
+    if (count <= PARALLEL_SORT_GRAIN) {
+        sort(data, data + count);
+        if (intoBuffer) copy(data, data + count, buffer);
+        return;
+    }
+
+    size_t half = count / 2;
+    TaskGroup group(pool);
+    group.run([=, &pool]() { parallelSortRange(data, buffer, half, !intoBuffer, pool); });
+    parallelSortRange(data + half, buffer + half, count - half, !intoBuffer, pool);
+    group.wait();
+
+    if (intoBuffer) parallelMerge(data, half, data + half, count - half, buffer, pool);
+    else parallelMerge(buffer, half, buffer + half, count - half, data, pool);
+}
+
+void parallelSortAndDedup(vector<int>& elements, WorkStealingPool& pool) {
+    if (adjacent_find(elements.begin(), elements.end(), [](int a, int b) { return a >= b; }) == elements.end()) {
+        return;
+    }
+    vector<int> buffer(elements.size());
+    parallelSortRange(elements.data(), buffer.data(), elements.size(), false, pool);
+    elements.erase(unique(elements.begin(), elements.end()), elements.end());
+}
+
+const int PARALLEL_BUILD_GRAIN = 1 << 14;
+
+// Узел для sorted[i] всегда лежит в block[i], поэтому половины строятся независимо
+AVLTree* buildBalancedRangeParallel(const int* sorted, AVLTree* block, int lo, int hi, WorkStealingPool& pool) {
+    if (lo > hi) return nullptr;
+
+    int mid = lo + (hi - lo) / 2;
+    AVLTree* node = new (block + mid) AVLTree(sorted[mid]);
+    if (hi - lo > PARALLEL_BUILD_GRAIN) {
+        TaskGroup group(pool);
+        group.run([=, &pool]() { node->left = buildBalancedRangeParallel(sorted, block, lo, mid - 1, pool); });
+        node->right = buildBalancedRangeParallel(sorted, block, mid + 1, hi, pool);
+        group.wait();
+    }
+    else {
+        node->left = buildBalancedRangeParallel(sorted, block, lo, mid - 1, pool);
+        node->right = buildBalancedRangeParallel(sorted, block, mid + 1, hi, pool);
+    }
+    updateNode(node);
+    return node;
+}
+
+AVLTree* buildBalancedAVLParallel(const vector<int>& sorted, WorkStealingPool& pool) {
+    if (sorted.empty()) return nullptr;
+
+    AVLTree* block = avlTreeArena.allocateBlock(sorted.size());
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    return buildBalancedRangeParallel(sorted.data(), block, 0, (int)sorted.size() - 1, pool);
+}
+
+void convertToAVL(BinaryTree* binaryRoot, AVLTree*& avlRoot, bool printElements = true) {
+    if (!binaryRoot) return;
+    vector<int> elements;
+    collectPreOrderParallel(binaryRoot, elements, sharedPool());
+
+    if (printElements) {
+        cout << "Элементы в порядке КЛП: ";
+        for (int elem : elements) {
+            cout << elem << " ";
+        }
+        cout << endl;
+    }
+
+    // В уже непустое дерево элементы добавляются по одному
+    if (avlRoot) {
+        for (int elem : elements) {
+            avlRoot = insertAVL(avlRoot, elem);
+        }
+        return;
+    }
+
+    parallelSortAndDedup(elements, sharedPool());
+    avlRoot = buildBalancedAVLParallel(elements, sharedPool());
+}
+
+// Операции над множествами на основе join. Узлы входных деревьев переиспользуются, новые
+// не выделяются; деревья должны быть из avlTreeArena и после операции не используются.
+// Объединение, пересечение и разность m и n ключей (m <= n) стоят O(m log(n/m + 1))
+
+// Спуск по правому краю более высокого левого дерева до поддерева, сравнимого по высоте
+// с правым, и балансировка на обратном пути
+AVLTree* joinRightAVL(AVLTree* left, AVLTree* middle, AVLTree* right) {
+    if (getHeight(left->right) <= getHeight(right) + 1) {
+        middle->left = left->right;
+        middle->right = right;
+        updateNode(middle);
+        left->right = middle;
+    }
+    else {
+        left->right = joinRightAVL(left->right, middle, right);
+    }
+    return rebalanceAVL(left);
+}
+
+AVLTree* joinLeftAVL(AVLTree* left, AVLTree* middle, AVLTree* right) {
+    if (getHeight(right->left) <= getHeight(left) + 1) {
+        middle->left = left;
+        middle->right = right->left;
+        updateNode(middle);
+        right->left = middle;
+    }
+    else {
+        right->left = joinLeftAVL(left, middle, right->left);
+    }
+    return rebalanceAVL(right);
+}
+
+// Соединение через узел middle: все ключи left меньше middle->data, все ключи right больше.
+// Стоит O(|h(left) - h(right)| + 1)
+AVLTree* joinNodeAVL(AVLTree* left, AVLTree* middle, AVLTree* right) {
+    if (getHeight(left) > getHeight(right) + 1) return joinRightAVL(left, middle, right);
+    if (getHeight(right) > getHeight(left) + 1) return joinLeftAVL(left, middle, right);
+    middle->left = left;
+    middle->right = right;
+    updateNode(middle);
+    return middle;
+}
+
+// Отделение узла с наибольшим ключом; возвращает оставшееся дерево
+AVLTree* splitLastAVL(AVLTree* root, AVLTree*& last) {
+    if (!root->right) {
+        last = root;
+        AVLTree* rest = root->left;
+        root->left = nullptr;
+        return rest;
+    }
+    AVLTree* rest = splitLastAVL(root->right, last);
+    return joinNodeAVL(root->left, root, rest);
+}
+
+// Соединение без среднего ключа: все ключи left меньше ключей right
+AVLTree* joinTwoAVL(AVLTree* left, AVLTree* right) {
+    if (!left) return right;
+    AVLTree* last;
+    AVLTree* rest = splitLastAVL(left, last);
+    return joinNodeAVL(rest, last, right);
+}
+
+// Разрезание по key на ключи меньше и больше него; узел с самим key, если он есть,
+// возвращается отсоединённым
+AVLTree* splitNodeAVL(AVLTree* root, int key, AVLTree*& less, AVLTree*& greater) {
+    if (!root) {
+        less = greater = nullptr;
+        return nullptr;
+    }
+
+    AVLTree* left = root->left;
+    AVLTree* right = root->right;
+    if (key < root->data) {
+        AVLTree* found = splitNodeAVL(left, key, less, greater);
+        greater = joinNodeAVL(greater, root, right);
+        return found;
+    }
+    if (key > root->data) {
+        AVLTree* found = splitNodeAVL(right, key, less, greater);
+        less = joinNodeAVL(left, root, less);
+        return found;
+    }
+
+    less = left;
+    greater = right;
+    root->left = root->right = nullptr;
+    updateNode(root);
+    return root;
+}
+
+const int PARALLEL_SET_GRAIN = 1 << 14;
+
+typedef AVLTree* (*SetOperationAVL)(AVLTree*, AVLTree*, vector<AVLTree*>&, WorkStealingPool*);
+
+// Две независимые половины операции. Крупные половины выполняются параллельно; пул узлов
+// не потокобезопасен, поэтому лишние узлы не освобождаются сразу, а копятся в discarded,
+// у каждой задачи свой список
+void runSetHalvesAVL(SetOperationAVL operation, AVLTree* a1, AVLTree* b1, AVLTree*& result1, AVLTree* a2,
+                     AVLTree* b2, AVLTree*& result2, vector<AVLTree*>& discarded, WorkStealingPool* pool) {
+    if (pool && getSize(a1) + getSize(b1) + getSize(a2) + getSize(b2) > PARALLEL_SET_GRAIN) {
+        vector<AVLTree*> firstDiscarded;
+        TaskGroup group(*pool);
+        group.run([&]() { result1 = operation(a1, b1, firstDiscarded, pool); });
+        result2 = operation(a2, b2, discarded, pool);
+        group.wait();
+        discarded.insert(discarded.end(), firstDiscarded.begin(), firstDiscarded.end());
+    }
+    else {
+        result1 = operation(a1, b1, discarded, pool);
+        result2 = operation(a2, b2, discarded, pool);
+    }
+}
+
+AVLTree* unionRecAVL(AVLTree* a, AVLTree* b, vector<AVLTree*>& discarded, WorkStealingPool* pool) {
+    if (!a) return b;
+    if (!b) return a;
+
+    AVLTree* lessB;
+    AVLTree* greaterB;
+    AVLTree* duplicate = splitNodeAVL(b, a->data, lessB, greaterB);
+    if (duplicate) discarded.push_back(duplicate);
+
+    AVLTree* left;
+    AVLTree* right;
+    runSetHalvesAVL(unionRecAVL, a->left, lessB, left, a->right, greaterB, right, discarded, pool);
+    return joinNodeAVL(left, a, right);
+}
+
+AVLTree* intersectionRecAVL(AVLTree* a, AVLTree* b, vector<AVLTree*>& discarded, WorkStealingPool* pool) {
+    if (!a || !b) {
+        if (a) discarded.push_back(a);
+        if (b) discarded.push_back(b);
+        return nullptr;
+    }
+
+    AVLTree* lessB;
+    AVLTree* greaterB;
+    AVLTree* duplicate = splitNodeAVL(b, a->data, lessB, greaterB);
+
+    AVLTree* left;
+    AVLTree* right;
+    runSetHalvesAVL(intersectionRecAVL, a->left, lessB, left, a->right, greaterB, right, discarded, pool);
+    if (duplicate) {
+        discarded.push_back(duplicate);
+        return joinNodeAVL(left, a, right);
+    }
+    a->left = a->right = nullptr;
+    discarded.push_back(a);
+    return joinTwoAVL(left, right);
+}
+
+AVLTree* differenceRecAVL(AVLTree* a, AVLTree* b, vector<AVLTree*>& discarded, WorkStealingPool* pool) {
+    if (!a || !b) {
+        if (b) discarded.push_back(b);
+        return a;
+    }
+
+    AVLTree* lessA;
+    AVLTree* greaterA;
+    AVLTree* removed = splitNodeAVL(a, b->data, lessA, greaterA);
+    if (removed) discarded.push_back(removed);
+
+    AVLTree* left;
+    AVLTree* right;
+    runSetHalvesAVL(differenceRecAVL, lessA, b->left, left, greaterA, b->right, right, discarded, pool);
+    b->left = b->right = nullptr;
+    discarded.push_back(b);
+    return joinTwoAVL(left, right);
+}
+
+// Общая обёртка: выполнение операции и освобождение накопленных узлов уже в вызывающем потоке
+AVLTree* runSetOperationAVL(SetOperationAVL operation, AVLTree* a, AVLTree* b, WorkStealingPool* pool) {
+    vector<AVLTree*> discarded;
+    AVLTree* result = operation(a, b, discarded, pool);
+    for (AVLTree* subtree : discarded) {
+        deleteAVLTree(subtree);
+    }
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    return result;
+}
+
+// Соединение деревьев через новый узел key; все ключи left меньше key, все ключи right больше
+AVLTree* joinAVL(AVLTree* left, int key, AVLTree* right) {
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    return joinNodeAVL(left, avlTreeArena.create(key), right);
+}
+
+// Разрезание дерева: в less попадают ключи меньше key, в greater — не меньше key
+void splitAVL(AVLTree* root, int key, AVLTree*& less, AVLTree*& greater) {
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+    AVLTree* found = splitNodeAVL(root, key, less, greater);
+    if (found) greater = joinNodeAVL(nullptr, found, greater);
+}
+
+// pool == nullptr — последовательное выполнение
+AVLTree* unionAVL(AVLTree* a, AVLTree* b, WorkStealingPool* pool = nullptr) {
+    return runSetOperationAVL(unionRecAVL, a, b, pool);
+}
+
+AVLTree* intersectionAVL(AVLTree* a, AVLTree* b, WorkStealingPool* pool = nullptr) {
+    return runSetOperationAVL(intersectionRecAVL, a, b, pool);
+}
+
+// Ключи a, которых нет в b
+AVLTree* differenceAVL(AVLTree* a, AVLTree* b, WorkStealingPool* pool = nullptr) {
+    return runSetOperationAVL(differenceRecAVL, a, b, pool);
+}
+
+// Буфер записи перед АВЛ деревом: вставки и удаления копятся в хеш-таблице (для ключа
+// остаётся последняя операция) и применяются пачкой в порядке возрастания ключей. Пачка,
+// сравнимая с деревом, собирается в сбалансированные деревья и сливается с основным через
+// differenceAVL/unionAVL. Небольшая пачка применяется группами по INGEST_GROUP ключей: общий
+// спуск группы с предвыборкой подтягивает в кэш её пути, и вставки идут уже по горячим узлам.
+// Поиск сначала смотрит в буфер, поэтому отложенные записи видны сразу
+const size_t INGEST_GROUP = 16;
+// Пачка не меньше размера дерева, делённого на это число, сливается join-объединением
+const size_t INGEST_JOIN_DIVISOR = 8;
+
+class AVLIngestBuffer {
+public:
+    explicit AVLIngestBuffer(size_t capacity = 1 << 14) : capacity(capacity) {
+        pending.reserve(capacity);
+    }
+
+    void insert(int key) {
+        pending[key] = true;
+    }
+
+    void remove(int key) {
+        pending[key] = false;
+    }
+
+    // 1 — ключ вставлен в буфере, 0 — удалён в буфере, -1 — буфер о ключе не знает
+    int lookup(int key) const {
+        if (pending.empty()) return -1;
+        unordered_map<int, bool>::const_iterator it = pending.find(key);
+        return it == pending.end() ? -1 : it->second;
+    }
+
+    bool contains(AVLTree* root, int key) const {
+        int state = lookup(key);
+        return state >= 0 ? state == 1 : searchAVL(root, key) != nullptr;
+    }
+
+    bool isEmpty() const {
+        return pending.empty();
+    }
+
+    bool isFull() const {
+        return pending.size() >= capacity;
+    }
+
+    // Применение всех отложенных операций; возвращает новый корень
+    AVLTree* apply(AVLTree* root) {
+        if (pending.empty()) return root;
+
+        inserts.clear();
+        deletes.clear();
+        for (const pair<const int, bool>& operation : pending) {
+            (operation.second ? inserts : deletes).push_back(operation.first);
+        }
+        pending.clear();
+
+        // Множества ключей не пересекаются, поэтому порядок применения не важен
+        sort(deletes.begin(), deletes.end());
+        sort(inserts.begin(), inserts.end());
+        // Ключи пачки через join не проходят insertAVL и deleteAVL, поэтому пачка замеряется здесь
+        if ((deletes.size() + inserts.size()) * INGEST_JOIN_DIVISOR >= (size_t)getSize(root)) {
+            if (!deletes.empty()) {
+                TREE_STAT(OperationTimer timer(OP_DELETE_BATCH, deletes.size());)
+                root = differenceAVL(root, buildBalancedAVL(deletes), &sharedPool());
+            }
+            if (!inserts.empty()) {
+                TREE_STAT(OperationTimer timer(OP_INSERT_BATCH, inserts.size());)
+                root = unionAVL(root, buildBalancedAVL(inserts), &sharedPool());
+            }
+        }
+        else {
+            root = applyGrouped(root, deletes, false);
+            root = applyGrouped(root, inserts, true);
+        }
+        return root;
+    }
+
+private:
+    static AVLTree* applyGrouped(AVLTree* root, const vector<int>& keys, bool insert) {
+        AVLTree* found[INGEST_GROUP];
+        for (size_t base = 0; base < keys.size(); base += INGEST_GROUP) {
+            size_t lanes = min(INGEST_GROUP, keys.size() - base);
+            searchAVLBatch(root, keys.data() + base, lanes, found);
+            for (size_t j = 0; j < lanes; j++) {
+                if (insert) {
+                    if (!found[j]) root = insertAVL(root, keys[base + j]);
+                }
+                else if (found[j]) {
+                    root = deleteAVL(root, keys[base + j]);
+                }
+            }
+        }
+        return root;
+    }
+
+    size_t capacity;
+    unordered_map<int, bool> pending;
+    vector<int> inserts;
+    vector<int> deletes;
+};
+
+// Бинарный формат деревьев. После заголовка идут ключи в прямом порядке (int32), затем биты
+// структуры: по два бита на узел (есть левый потомок, есть правый), упакованные в uint64.
+// Порядок байтов — машины, записавшей файл; он проверяется по полю byteOrder
+const char TREE_FILE_MAGIC[4] = { 'T', 'R', 'E', 'E' };
+const uint32_t TREE_FILE_VERSION = 1;
+const uint32_t TREE_FILE_BYTE_ORDER = 0x01020304;
+
+enum TreeFileKind : uint32_t {
+    TREE_FILE_BINARY = 0,
+    TREE_FILE_AVL = 1,
+    TREE_FILE_INVALID = 0xFFFFFFFF
+};
+
+struct TreeFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t byteOrder;
+    uint64_t nodeCount;
+};
+
+size_t treeFileKeysBytes(uint64_t nodeCount) {
+    // Ключи дополняются до 8 байт, чтобы слова битов структуры были выровнены
+    return (size_t)((nodeCount * sizeof(int32_t) + 7) / 8 * 8);
+}
+
+size_t treeFileStructureWords(uint64_t nodeCount) {
+    return (size_t)((2 * nodeCount + 63) / 64);
+}
+
+template <typename Node>
+bool saveTreeFile(Node* root, TreeFileKind kind, const string& filename) {
+    vector<int32_t> keys;
+    vector<uint64_t> structure;
+
+    TraversalBuffer<Node*>& stack = traversalScratch<Node*>();
+    if (root) stack.push(root);
+    while (!stack.isEmpty()) {
+        Node* current = stack.pop();
+        size_t bit = 2 * keys.size();
+        if (bit % 64 == 0) structure.push_back(0);
+        if (current->left) structure.back() |= 1ull << (bit % 64);
+        if (current->right) structure.back() |= 2ull << (bit % 64);
+        keys.push_back(current->data);
+
+        if (current->right) stack.push(current->right);
+        if (current->left) stack.push(current->left);
+    }
+
+    ofstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        cout << "Ошибка открытия файла!" << endl;
+        return false;
+    }
+
+    TreeFileHeader header;
+    memcpy(header.magic, TREE_FILE_MAGIC, sizeof(header.magic));
+    header.version = TREE_FILE_VERSION;
+    header.kind = kind;
+    header.byteOrder = TREE_FILE_BYTE_ORDER;
+    header.nodeCount = keys.size();
+
+    keys.resize(treeFileKeysBytes(header.nodeCount) / sizeof(int32_t), 0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(int32_t));
+    file.write(reinterpret_cast<const char*>(structure.data()), structure.size() * sizeof(uint64_t));
+    if (!file) {
+        cout << "Ошибка записи файла!" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool saveBinaryTreeFile(BinaryTree* root, const string& filename) {
+    return saveTreeFile(root, TREE_FILE_BINARY, filename);
+}
+
+bool saveAVLTreeFile(AVLTree* root, const string& filename) {
+    return saveTreeFile(root, TREE_FILE_AVL, filename);
+}
+
+// Проверка заголовка и размера; возвращает вид дерева или TREE_FILE_INVALID
+TreeFileKind checkTreeFile(const MappedFile& file) {
+    if (file.size() < sizeof(TreeFileHeader)) return TREE_FILE_INVALID;
+
+    TreeFileHeader header;
+    memcpy(&header, file.begin(), sizeof(header));
+    if (memcmp(header.magic, TREE_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != TREE_FILE_VERSION ||
+        header.byteOrder != TREE_FILE_BYTE_ORDER || header.kind > TREE_FILE_AVL ||
+        header.nodeCount > (uint64_t)INT_MAX) {
+        return TREE_FILE_INVALID;
+    }
+
+    size_t expected = sizeof(header) + treeFileKeysBytes(header.nodeCount) +
+                      treeFileStructureWords(header.nodeCount) * sizeof(uint64_t);
+    if (file.size() != expected) return TREE_FILE_INVALID;
+    return (TreeFileKind)header.kind;
+}
+
+TreeFileKind readTreeFileKind(const string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) return TREE_FILE_INVALID;
+    return checkTreeFile(file);
+}
+
+void finishLoadedNodes(BinaryTree*, size_t) {}
+
+// Потомки узла лежат в блоке правее него, поэтому высоты и размеры считаются одним проходом справа налево
+void finishLoadedNodes(AVLTree* block, size_t count) {
+    for (size_t i = count; i-- > 0;) {
+        updateNode(&block[i]);
+    }
+    avlTreeVersion.fetch_add(1, memory_order_relaxed);
+}
+
+// Форма двоичного дерева любая, а АВЛ дерево из файла должно быть корректным: иначе
+// вставки и удаления с путём в AVL_MAX_HEIGHT узлов выйдут за его границы
+bool checkLoadedTree(BinaryTree*) {
+    return true;
+}
+
+bool checkLoadedTree(AVLTree* root) {
+    if (getHeight(root) > AVL_MAX_HEIGHT) {
+        cout << "Высота дерева " << getHeight(root) << " больше допустимой " << AVL_MAX_HEIGHT << endl;
+        return false;
+    }
+    return isValidAVL(root);
+}
+
+// Узлы создаются в одном непрерывном блоке пула в прямом порядке и связываются по битам структуры.
+// При ошибке блок возвращается пулу
+template <typename Node>
+bool loadTreeFile(const string& filename, TreeFileKind kind, NodeArena<Node>& arena, Node*& root) {
+    root = nullptr;
+    MappedFile file;
+    if (!file.open(filename)) {
+        cout << "Ошибка открытия файла!" << endl;
+        return false;
+    }
+    if (checkTreeFile(file) != kind) {
+        cout << "Ошибка: файл не является сохранённым деревом нужного вида!" << endl;
+        return false;
+    }
+
+    TreeFileHeader header;
+    memcpy(&header, file.begin(), sizeof(header));
+    size_t count = (size_t)header.nodeCount;
+    if (count == 0) return true;
+
+    const int32_t* keys = reinterpret_cast<const int32_t*>(file.begin() + sizeof(header));
+    const uint64_t* structure = reinterpret_cast<const uint64_t*>(file.begin() + sizeof(header) + treeFileKeysBytes(count));
+
+    Node* block = arena.allocateBlock(count);
+    TraversalBuffer<Node*>& awaitingRight = traversalScratch<Node*>();
+    Node** slot = &root;
+    for (size_t i = 0; i < count; i++) {
+        if (!slot) {
+            cout << "Ошибка: повреждена структура дерева в узле " << i << "!" << endl;
+            root = nullptr;
+            arena.releaseLastBlock(block, count);
+            return false;
+        }
+
+        Node* node = new (block + i) Node(keys[i]);
+        *slot = node;
+
+        uint64_t bits = structure[2 * i / 64] >> (2 * i % 64);
+        if (bits & 2) awaitingRight.push(node);
+        if (bits & 1) slot = &node->left;
+        else slot = awaitingRight.isEmpty() ? nullptr : &awaitingRight.pop()->right;
+    }
+    if (slot) {
+        cout << "Ошибка: повреждена структура дерева, узлов меньше, чем указано!" << endl;
+        root = nullptr;
+        arena.releaseLastBlock(block, count);
+        return false;
+    }
+
+    finishLoadedNodes(block, count);
+    if (!checkLoadedTree(root)) {
+        cout << "Ошибка: дерево в файле не является корректным АВЛ деревом!" << endl;
+        root = nullptr;
+        arena.releaseLastBlock(block, count);
+        return false;
+    }
+    return true;
+}
+
+BinaryTree* loadBinaryTreeFile(const string& filename) {
+    BinaryTree* root = nullptr;
+    loadTreeFile(filename, TREE_FILE_BINARY, binaryTreeArena, root);
+    return root;
+}
+
+AVLTree* loadAVLTreeFile(const string& filename) {
+    AVLTree* root = nullptr;
+    loadTreeFile(filename, TREE_FILE_AVL, avlTreeArena, root);
+    return root;
+}
+
+// АВЛ дерево из файла любого вида: бинарный файл АВЛ или двоичного дерева либо скобочная
+// запись. Промежуточное двоичное дерево освобождается
+AVLTree* loadAVLTreeAnyFormat(const string& filename) {
+    TreeFileKind kind = readTreeFileKind(filename);
+    if (kind == TREE_FILE_AVL) return loadAVLTreeFile(filename);
+
+    BinaryTree* binaryRoot = kind == TREE_FILE_BINARY ? loadBinaryTreeFile(filename) : createBinaryTreeFromFile(filename);
+    AVLTree* root = nullptr;
+    convertToAVL(binaryRoot, root, false);
+    deleteBinaryTree(binaryRoot);
+    return root;
+}
+
+// Замеры производительности
+
+double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+vector<int> generateRandomKeys(int count, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> dist(-count * 4, count * 4);
+    vector<int> keys(count);
+    for (int& key : keys) key = dist(rng);
+    return keys;
+}
+
+// Сравнение построения АВЛ дерева вставками и пакетной сборкой
+void benchmarkBuildAVL(int count) {
+    vector<int> keys = generateRandomKeys(count, 42);
+
+    auto start = chrono::steady_clock::now();
+    AVLTree* inserted = nullptr;
+    for (int key : keys) {
+        inserted = insertAVL(inserted, key);
+    }
+    double insertMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    vector<int> sorted = keys;
+    sortAndDedup(sorted);
+    AVLTree* built = buildBalancedAVL(sorted);
+    double bulkMs = elapsedMs(start);
+
+    cout << "Элементов: " << count << ", различных: " << sorted.size() << endl;
+    cout << "Вставки по одному: " << insertMs << " мс (высота " << getHeight(inserted) << ")" << endl;
+    cout << "Сортировка и сборка: " << bulkMs << " мс (высота " << getHeight(built) << ")" << endl;
+    cout << "Ускорение: " << (bulkMs > 0 ? insertMs / bulkMs : 0) << "x" << endl;
+
+    // Пакетная сборка в пул, где уже есть дерево, и вставки после неё не должны задевать узлы блока
+    AVLTree* bulk = buildBalancedAVLParallel(sorted, sharedPool());
+    for (int key : generateRandomKeys(min(count, 10000), 43)) {
+        inserted = insertAVL(inserted, key);
+        bulk = insertAVL(bulk, key);
+    }
+    if (!isValidAVL(inserted) || !isValidAVL(bulk)) {
+        cout << "Ошибка: вставки после пакетной сборки повредили дерево!" << endl;
+    }
+
+    deleteAVLTree(bulk);
+    deleteAVLTree(inserted);
+    deleteAVLTree(built);
+}
+
+// Сравнение поиска по указателям АВЛ дерева и по плоскому снимку
+void benchmarkSearchAVL(int count) {
+    vector<int> keys = generateRandomKeys(count, 7);
+    AVLTree* root = nullptr;
+    for (int key : keys) {
+        root = insertAVL(root, key);
+    }
+    // Половина запросов — существующие ключи
+    vector<int> queries = generateRandomKeys(count, 8);
+    for (int i = 0; i < count; i += 2) {
+        queries[i] = keys[(unsigned)queries[i] % count];
+    }
+
+    auto start = chrono::steady_clock::now();
+    int found = 0;
+    for (int key : queries) {
+        found += searchAVL(root, key) != nullptr;
+    }
+    double pointerMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    avlSnapshot.build(root);
+    double buildMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    int flatFound = 0;
+    for (int key : queries) {
+        flatFound += avlSnapshot.contains(key);
+    }
+    double flatMs = elapsedMs(start);
+
+    vector<AVLTree*> handles(count);
+    start = chrono::steady_clock::now();
+    searchAVLBatch(root, queries.data(), count, handles.data());
+    double batchMs = elapsedMs(start);
+    int batchFound = (int)(count - std::count(handles.begin(), handles.end(), nullptr));
+
+    unique_ptr<bool[]> flags(new bool[count]);
+    start = chrono::steady_clock::now();
+    avlSnapshot.containsBatch(queries.data(), count, flags.get());
+    double flatBatchMs = elapsedMs(start);
+    int flatBatchFound = (int)std::count(flags.get(), flags.get() + count, true);
+
+    bool consistent = found == flatFound && found == batchFound && found == flatBatchFound;
+    cout << "Поисков: " << count << ", найдено: " << found << (consistent ? "" : " (результаты расходятся!)") << endl;
+    cout << "searchAVL: " << pointerMs * 1e6 / count << " нс/поиск" << endl;
+    cout << "searchAVLBatch: " << batchMs * 1e6 / count << " нс/поиск" << endl;
+    cout << "Плоский снимок: " << flatMs * 1e6 / count << " нс/поиск (построение " << buildMs << " мс)" << endl;
+    cout << "Плоский снимок, пакетно: " << flatBatchMs * 1e6 / count << " нс/поиск" << endl;
+
+    deleteAVLTree(root);
+}
+
+// Вставка и удаление на случайных, возрастающих и "пилообразных" потоках ключей
+void benchmarkInsertDeleteAVL(int count) {
+    vector<int> random = generateRandomKeys(count, 11);
+    vector<int> sequential(count);
+    for (int i = 0; i < count; i++) sequential[i] = i;
+    // Ключи попеременно с краёв к середине: каждая вставка уходит в самый глубокий край
+    vector<int> zigzag(count);
+    for (int i = 0, lo = 0, hi = count - 1; i < count; i++) {
+        zigzag[i] = (i % 2 == 0) ? lo++ : hi--;
+    }
+
+    struct Stream {
+        const char* name;
+        const vector<int>* keys;
+    };
+    Stream streams[] = { { "случайные", &random }, { "возрастающие", &sequential }, { "пилообразные", &zigzag } };
+
+    for (const Stream& stream : streams) {
+        AVLTree* root = nullptr;
+        auto start = chrono::steady_clock::now();
+        for (int key : *stream.keys) {
+            root = insertAVL(root, key);
+        }
+        double insertMs = elapsedMs(start);
+        int height = getHeight(root);
+
+        start = chrono::steady_clock::now();
+        for (int key : *stream.keys) {
+            root = deleteAVL(root, key);
+        }
+        double deleteMs = elapsedMs(start);
+
+        cout << stream.name << ": вставка " << insertMs * 1e6 / count << " нс/оп, удаление "
+             << deleteMs * 1e6 / count << " нс/оп, высота " << height
+             << (root ? " (дерево не опустело!)" : "") << endl;
+    }
+}
+
+// Обычные узлы против компактных: память на узел и время вставки, поиска и удаления
+void benchmarkCompactAVL(int count) {
+    vector<int> keys = generateRandomKeys(count, 71);
+    vector<int> queries = generateRandomKeys(count, 72);
+    size_t found = 0;
+
+    AVLTree* root = nullptr;
+    auto start = chrono::steady_clock::now();
+    for (int key : keys) root = insertAVL(root, key);
+    double insertMs = elapsedMs(start);
+    // Пул кладёт узлы вплотную, поэтому память обычного дерева — размер узла на их число
+    int nodes = getSize(root);
+    double megabytes = (double)nodes * sizeof(AVLTree) / (1 << 20);
+    start = chrono::steady_clock::now();
+    for (int key : queries) found += searchAVL(root, key) != nullptr;
+    double searchMs = elapsedMs(start);
+    start = chrono::steady_clock::now();
+    for (int key : keys) root = deleteAVL(root, key);
+    double deleteMs = elapsedMs(start);
+    cout << "Обычные узлы (" << sizeof(AVLTree) << " байт): " << megabytes << " МБ, вставка "
+         << insertMs * 1e6 / count << " нс, поиск " << searchMs * 1e6 / count << " нс, удаление "
+         << deleteMs * 1e6 / count << " нс" << endl;
+
+    // Память обоих деревьев считается по занятым узлам; запас вектора при заранее
+    // зарезервированной ёмкости — только повторы ключей, и выводится отдельно
+    CompactAVLTree compact;
+    compact.reserve(count);
+    start = chrono::steady_clock::now();
+    for (int key : keys) compact.insert(key);
+    insertMs = elapsedMs(start);
+    double regularMegabytes = megabytes;
+    megabytes = (double)compact.size() * sizeof(CompactAVLNode) / (1 << 20);
+    double capacityMegabytes = (double)compact.memoryBytes() / (1 << 20);
+    start = chrono::steady_clock::now();
+    for (int key : queries) found -= compact.contains(key);
+    searchMs = elapsedMs(start);
+    int height = compact.height();
+    start = chrono::steady_clock::now();
+    for (int key : keys) compact.remove(key);
+    deleteMs = elapsedMs(start);
+    cout << "Компактные узлы (" << sizeof(CompactAVLNode) << " байт): " << megabytes << " МБ (ёмкость вектора "
+         << capacityMegabytes << " МБ), вставка " << insertMs * 1e6 / count << " нс, поиск " << searchMs * 1e6 / count
+         << " нс, удаление " << deleteMs * 1e6 / count << " нс, высота " << height
+         << (found ? " (результат расходится!)" : "") << endl;
+    cout << "Память на те же узлы меньше в " << regularMegabytes / megabytes << " раза" << endl;
+}
+
+static_assert(is_same<AVLMap<long long, string>::KeyArg, long long>::value, "малый ключ передаётся по значению");
+static_assert(is_same<AVLMap<string, int>::KeyArg, const string&>::value, "строковый ключ передаётся по ссылке");
+
+// AVLMap с 64-битными ключами, строковыми значениями и обратным порядком против std::map
+// с теми же параметрами; результаты каждой операции сверяются
+void benchmarkAVLMap(int count) {
+    mt19937_64 rng(81);
+    vector<long long> keys(count);
+    for (long long& key : keys) key = (long long)(rng() >> 1) - (LLONG_MAX >> 1);
+    vector<long long> queries(keys.begin(), keys.begin() + count / 2);
+    for (int i = count / 2; i < count; i++) queries.push_back((long long)(rng() >> 1));
+
+    typedef greater<long long> Order;
+    AVLMap<long long, string, Order> tree;
+    map<long long, string, Order> reference;
+    size_t mismatches = 0;
+    int half = count / 2;
+
+    // Первая половина вставляется готовыми строками, вторая создаётся в узле из (длина, символ)
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < half; i++) tree.insert(keys[i], to_string(keys[i]));
+    for (int i = half; i < count; i++) tree.emplace(keys[i], (size_t)(i % 16 + 1), 'a' + i % 26);
+    double treeInsertMs = elapsedMs(start);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < half; i++) reference.insert(make_pair(keys[i], to_string(keys[i])));
+    for (int i = half; i < count; i++) reference.emplace(piecewise_construct, forward_as_tuple(keys[i]),
+                                                         forward_as_tuple((size_t)(i % 16 + 1), 'a' + i % 26));
+    double mapInsertMs = elapsedMs(start);
+
+    for (int i = 0; i < count; i += 7) {
+        tree.insertOrAssign(keys[i], string("новое"));
+        reference[keys[i]] = "новое";
+    }
+    // При обратном порядке крайний левый узел — наибольший ключ
+    const AVLMapNode<long long, string>* leftmost = tree.rootNode();
+    while (leftmost && leftmost->left) leftmost = leftmost->left;
+    if (tree.size() != reference.size() || (leftmost && leftmost->key != reference.begin()->first)) mismatches++;
+
+    vector<const string*> found(queries.size());
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < queries.size(); i++) found[i] = tree.find(queries[i]);
+    double treeFindMs = elapsedMs(start);
+    vector<map<long long, string, Order>::const_iterator> expected(queries.size());
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < queries.size(); i++) expected[i] = reference.find(queries[i]);
+    double mapFindMs = elapsedMs(start);
+    for (size_t i = 0; i < queries.size(); i++) {
+        bool missing = expected[i] == reference.end();
+        if ((found[i] == nullptr) != missing || (found[i] && *found[i] != expected[i]->second)) mismatches++;
+    }
+
+    vector<char> erased;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i += 2) erased.push_back(tree.erase(keys[i]));
+    double treeEraseMs = elapsedMs(start);
+    vector<char> expectedErased;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i += 2) expectedErased.push_back(reference.erase(keys[i]) == 1);
+    double mapEraseMs = elapsedMs(start);
+    if (erased != expectedErased) mismatches++;
+    for (long long key : queries) {
+        if (tree.contains(key) != (reference.count(key) == 1)) mismatches++;
+    }
+    int height = tree.height();
+    size_t remaining = tree.size();
+    tree.clear();
+    if (tree.size() != 0 || tree.rootNode()) mismatches++;
+
+    int erases = (int)erased.size();
+    cout << "AVLMap<long long, string, greater>: вставка " << treeInsertMs * 1e6 / count << " нс, поиск "
+         << treeFindMs * 1e6 / queries.size() << " нс, удаление " << treeEraseMs * 1e6 / erases << " нс, высота "
+         << height << endl;
+    cout << "std::map с теми же параметрами: вставка " << mapInsertMs * 1e6 / count << " нс, поиск "
+         << mapFindMs * 1e6 / queries.size() << " нс, удаление " << mapEraseMs * 1e6 / erases << " нс, осталось "
+         << remaining << (mismatches ? " (результаты расходятся!)" : "") << endl;
+}
+
+// Набор ключей, заданный при сборке: (i * 7919) mod 100003 различны, пока i < 100003.
+// Размер ограничен шагами вычисления constexpr у компиляторов
+const size_t STATIC_BENCH_KEYS = 511;
+const int STATIC_BENCH_RANGE = 100003;
+
+constexpr int staticBenchKey(size_t i) {
+    return (int)(i * 7919 % STATIC_BENCH_RANGE);
+}
+
+template <typename Sequence>
+struct StaticBenchSet;
+
+template <size_t... I>
+struct StaticBenchSet<index_sequence<I...>> {
+    typedef StaticKeySet<staticBenchKey(I)...> type;
+};
+
+typedef StaticBenchSet<make_index_sequence<STATIC_BENCH_KEYS>>::type BenchmarkKeySet;
+
+// Множество из ключей, известных при сборке, против АВЛ дерева, которое строится из тех же
+// ключей при запуске
+void benchmarkStaticKeySet(int count) {
+    mt19937 rng(101);
+    uniform_int_distribution<int> dist(0, STATIC_BENCH_RANGE - 1);
+    vector<int> queries(count);
+    for (int& key : queries) key = dist(rng);
+
+    auto start = chrono::steady_clock::now();
+    AVLTree* root = nullptr;
+    for (size_t i = 0; i < STATIC_BENCH_KEYS; i++) root = insertAVL(root, staticBenchKey(i));
+    double buildMs = elapsedMs(start);
+
+    size_t treeFound = 0;
+    start = chrono::steady_clock::now();
+    for (int key : queries) treeFound += searchAVL(root, key) != nullptr;
+    double treeMs = elapsedMs(start);
+
+    size_t staticFound = 0;
+    start = chrono::steady_clock::now();
+    for (int key : queries) staticFound += searchAVL(BenchmarkKeySet(), key) != nullptr;
+    double staticMs = elapsedMs(start);
+
+    bool same = treeFound == staticFound;
+    for (size_t i = 0; i < STATIC_BENCH_KEYS; i++) same = same && BenchmarkKeySet::contains(staticBenchKey(i));
+    cout << "Ключей: " << STATIC_BENCH_KEYS << ", найдено " << treeFound << " из " << count << endl;
+    cout << "АВЛ дерево: построение при запуске " << buildMs << " мс, поиск " << treeMs * 1e6 / count << " нс" << endl;
+    cout << "Множество при сборке: построение 0 мс, поиск " << staticMs * 1e6 / count << " нс"
+         << (same ? "" : " (результат расходится!)") << endl;
+    deleteAVLTree(root);
+}
+
+// Пик резидентной памяти процесса в байтах; 0, если узнать не удалось
+size_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return (size_t)atoll(line.c_str() + 6) * 1024;
+    }
+    return 0;
+#endif
+}
+
+// Сброс пика до текущего размера, чтобы следующий замер видел только новый прирост.
+// Есть только в Linux; без него пик растёт лишь тогда, когда превышен прежний максимум
+bool resetPeakResident() {
+#ifdef _WIN32
+    return false;
+#else
+    ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+    return clearRefs.good();
+#endif
+}
+
+// Обходы со стеком и очередью против обходов Морриса: время и прирост пика памяти. Каждый
+// обход идёт в новом потоке, чтобы буферы обходов выделялись заново, а не брались готовыми
+void benchmarkTraversalMemory(int count) {
+    vector<int> keys = generateRandomKeys(count, 81);
+    AVLTree* root = nullptr;
+    for (int key : keys) root = insertAVL(root, key);
+    int nodes = getSize(root);
+    const int REPEATS = 5;
+
+    const string kinds[] = { "bfs", "pre", "in", "post", "morris-pre", "morris-in", "morris-post" };
+    bool resetWorks = true;
+    for (const string& kind : kinds) {
+        NullSink sink;
+        double ms = 0;
+        resetWorks = resetPeakResident() && resetWorks;
+        size_t before = peakResidentBytes();
+        thread worker([&]() {
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < REPEATS; i++) traverseAVL(root, kind, sink);
+            ms = elapsedMs(start) / REPEATS;
+        });
+        worker.join();
+        size_t after = peakResidentBytes();
+
+        // Обход Морриса должен выдать ключи в том же порядке, что и обход со стеком
+        bool same = sink.count == (size_t)REPEATS * nodes;
+        if (kind.compare(0, 7, "morris-") == 0) {
+            vector<int> morrisOrder, stackOrder;
+            VectorSink morrisSink{ morrisOrder };
+            VectorSink stackSink{ stackOrder };
+            traverseAVL(root, kind, morrisSink);
+            traverseAVL(root, kind.substr(7), stackSink);
+            same = same && morrisOrder == stackOrder;
+        }
+        cout << kind << ": " << ms << " мс (" << ms * 1e6 / max(nodes, 1) << " нс на узел), прирост пика "
+             << (after > before ? (after - before) / 1024 : 0) << " КБ" << (same ? "" : " (порядок расходится!)") << endl;
+    }
+    if (!resetWorks) cout << "Сбросить пик памяти нельзя: прирост виден, только когда превышен прежний максимум" << endl;
+    if (!isValidAVL(root)) cout << "Ошибка: после обходов дерево повреждено!" << endl;
+    deleteAVLTree(root);
+}
+
+// Слияние маленького дерева с большим: вставка по одному против join-объединения,
+// последовательного и параллельного, а также пересечение и разность
+void benchmarkSetOperationsAVL(int count) {
+    vector<int> large = generateRandomKeys(count, 41);
+    vector<int> small = generateRandomKeys(max(count / 16, 1), 42);
+    sortAndDedup(large);
+    sortAndDedup(small);
+
+    AVLTree* a = buildBalancedAVL(large);
+    AVLTree* b = buildBalancedAVL(small);
+    auto start = chrono::steady_clock::now();
+    for (int key : keysAVL(b)) {
+        a = insertAVL(a, key);
+    }
+    double insertMs = elapsedMs(start);
+    int expectedSize = getSize(a);
+    deleteAVLTree(a);
+    deleteAVLTree(b);
+    cout << "Вставка " << small.size() << " ключей в дерево из " << large.size() << ": " << insertMs << " мс" << endl;
+
+    struct Operation {
+        const char* name;
+        AVLTree* (*run)(AVLTree*, AVLTree*, WorkStealingPool*);
+    };
+    Operation operations[] = { { "объединение", unionAVL }, { "пересечение", intersectionAVL }, { "разность", differenceAVL } };
+    for (const Operation& operation : operations) {
+        for (int parallel = 0; parallel < 2; parallel++) {
+            a = buildBalancedAVL(large);
+            b = buildBalancedAVL(small);
+            start = chrono::steady_clock::now();
+            AVLTree* result = operation.run(a, b, parallel ? &sharedPool() : nullptr);
+            double ms = elapsedMs(start);
+            cout << operation.name << (parallel ? " (параллельно)" : "") << ": " << ms << " мс, элементов "
+                 << getSize(result);
+            if (operation.run == unionAVL && getSize(result) != expectedSize) cout << " (результат расходится!)";
+            cout << endl;
+            deleteAVLTree(result);
+        }
+    }
+}
+
+// Поток вставок с десятой частью удалений в большое дерево: по одной операции против буфера записи
+void benchmarkIngestBuffer(int count) {
+    vector<int> base = generateRandomKeys(count, 61);
+    vector<int> incoming = generateRandomKeys(count, 62);
+    sortAndDedup(base);
+
+    AVLTree* root = buildBalancedAVL(base);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        if (i % 10 == 9) root = deleteAVL(root, incoming[i - 1]);
+        else root = insertAVL(root, incoming[i]);
+    }
+    double directMs = elapsedMs(start);
+    int expectedSize = getSize(root);
+    deleteAVLTree(root);
+    cout << "По одной: " << count / directMs / 1000 << " млн оп/с" << endl;
+
+    size_t capacities[] = { 1 << 10, 1 << 14, 1 << 17 };
+    for (size_t capacity : capacities) {
+        root = buildBalancedAVL(base);
+        AVLIngestBuffer buffer(capacity);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            if (i % 10 == 9) buffer.remove(incoming[i - 1]);
+            else buffer.insert(incoming[i]);
+            if (buffer.isFull()) root = buffer.apply(root);
+        }
+        root = buffer.apply(root);
+        double ms = elapsedMs(start);
+        cout << "Буфер на " << capacity << ": " << count / ms / 1000 << " млн оп/с, ускорение " << directMs / ms << "x"
+             << (getSize(root) != expectedSize ? " (результат расходится!)" : "") << endl;
+        deleteAVLTree(root);
+    }
+}
+
+// Удаление корня идеального дерева 1..31 переносит в корень преемника 17, вырезанного из-под 18.
+// Испорченная высота 18 должна найтись проверкой пути, хотя путь к 16 сворачивает от 17 влево
+bool testPathCheckAfterDelete() {
+    vector<int> keys(31);
+    for (int i = 0; i < 31; i++) keys[i] = i + 1;
+    AVLTree* root = deleteAVL(buildBalancedAVL(keys), 16);
+
+    AVLTree* parent = searchAVL(root, 18);
+    parent->height += 5;
+    bool caught = !checkPathAVL(root, 16);
+    parent->height -= 5;
+    bool ok = caught && checkPathAVL(root, 16) && isValidAVL(root);
+
+    cout << "Проверка пути после удаления узла с двумя потомками: порча "
+         << (caught ? "найдена" : "пропущена") << (ok ? " — OK" : " — ОШИБКА") << endl;
+    deleteAVLTree(root);
+    return ok;
+}
+
+// Проверка под нагрузкой: чётные ключи есть в дереве всегда, писатель вставляет и удаляет нечётные,
+// ключи за пределами диапазона не вставляются никогда. Читатель не должен ошибиться ни разу
+bool stressTestConcurrentAVL(int count, int readers, int durationMs) {
+    ConcurrentAVLTree tree;
+    for (int key = 0; key < 2 * count; key += 2) {
+        tree.insert(key);
+    }
+
+    atomic<bool> stop(false);
+    atomic<long long> errors(0);
+    atomic<long long> reads(0);
+    vector<thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            mt19937 rng(100 + r);
+            long long localReads = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                int key = (int)(rng() % (unsigned)(4 * count)) - count;
+                bool found = tree.contains(key);
+                bool alwaysPresent = key >= 0 && key < 2 * count && key % 2 == 0;
+                bool neverPresent = key < 0 || key >= 2 * count;
+                if ((alwaysPresent && !found) || (neverPresent && found)) {
+                    errors.fetch_add(1, memory_order_relaxed);
+                }
+                localReads++;
+            }
+            reads.fetch_add(localReads, memory_order_relaxed);
+        });
+    }
+
+    mt19937 rng(99);
+    long long writes = 0;
+    auto start = chrono::steady_clock::now();
+    while (elapsedMs(start) < durationMs) {
+        int key = 2 * (int)(rng() % (unsigned)count) + 1;
+        if (rng() % 2) tree.insert(key);
+        else tree.remove(key);
+        writes++;
+    }
+    stop.store(true);
+    for (thread& t : threads) t.join();
+
+    vector<int> keys;
+    bool ok = errors.load() == 0 && tree.isValid(keys);
+
+    cout << "Стресс-тест: читателей " << readers << ", чтений " << reads.load() << ", записей " << writes
+         << ", повторов чтения " << tree.retries() << ", ошибок " << errors.load()
+         << (ok ? " — OK" : " — ОШИБКА") << endl;
+    return ok;
+}
+
+// Пропускная способность при разной доле записей и числе потоков; каждый поток
+// выполняет свою долю операций, запись — вставка или удаление случайного ключа
+void benchmarkConcurrentAVL(int count) {
+    vector<int> keys = generateRandomKeys(count, 21);
+    unsigned hardwareThreads = thread::hardware_concurrency();
+    vector<unsigned> threadCounts;
+    for (unsigned threadCount = 1; threadCount < hardwareThreads; threadCount *= 2) {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(hardwareThreads ? hardwareThreads : 1);
+
+    int writePercents[] = { 0, 5, 50 };
+    for (int writePercent : writePercents) {
+        for (unsigned threadCount : threadCounts) {
+            ConcurrentAVLTree tree;
+            for (int key : keys) tree.insert(key);
+
+            int opsPerThread = count / (int)threadCount + 1;
+            vector<thread> threads;
+            auto start = chrono::steady_clock::now();
+            for (unsigned t = 0; t < threadCount; t++) {
+                threads.emplace_back([&, t]() {
+                    mt19937 rng(200 + t);
+                    for (int i = 0; i < opsPerThread; i++) {
+                        int key = keys[rng() % (unsigned)count];
+                        if ((int)(rng() % 100) < writePercent) {
+                            if (rng() % 2) tree.insert(key ^ 1);
+                            else tree.remove(key ^ 1);
+                        }
+                        else {
+                            tree.contains(key);
+                        }
+                    }
+                });
+            }
+            for (thread& t : threads) t.join();
+            double ms = elapsedMs(start);
+
+            cout << "записей " << writePercent << "%, потоков " << threadCount << ": "
+                 << opsPerThread * (double)threadCount / ms / 1000 << " млн оп/с" << endl;
+        }
+    }
+}
+
+// Снимок персистентного дерева против полной копии обычного и цена изменений с копированием пути
+void benchmarkPersistentAVL(int count) {
+    vector<int> keys = generateRandomKeys(count, 51);
+    PersistentAVLTree tree;
+    for (int key : keys) tree.insert(key);
+
+    AVLTree* plain = nullptr;
+    for (int key : keys) plain = insertAVL(plain, key);
+    auto start = chrono::steady_clock::now();
+    vector<int> elements;
+    collectInOrderAVL(plain, elements);
+    AVLTree* copy = buildBalancedAVL(elements);
+    double copyMs = elapsedMs(start);
+    deleteAVLTree(copy);
+    deleteAVLTree(plain);
+
+    const int snapshots = 1000000;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < snapshots; i++) {
+        PersistentAVLTree::Snapshot snapshot = tree.snapshot();
+    }
+    double snapshotMs = elapsedMs(start);
+    cout << "Снимок: " << snapshotMs * 1e6 / snapshots << " нс, полная копия обычного дерева: " << copyMs << " мс" << endl;
+
+    // Без снимков устаревший путь освобождается сразу, со снимком после каждого изменения — живёт вместе с ним
+    for (int withSnapshots = 0; withSnapshots < 2; withSnapshots++) {
+        vector<PersistentAVLTree::Snapshot> held;
+        size_t copiesBefore = tree.copies();
+        mt19937 rng(52);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            int key = keys[rng() % (unsigned)count] ^ 1;
+            if (rng() % 2) tree.insert(key);
+            else tree.remove(key);
+            if (withSnapshots) held.push_back(tree.snapshot());
+        }
+        double ms = elapsedMs(start);
+        cout << (withSnapshots ? "Изменения со снимком после каждого: " : "Изменения без снимков: ")
+             << ms * 1e6 / count << " нс/оп, копий узлов на изменение "
+             << (double)(tree.copies() - copiesBefore) / count << ", живых узлов " << tree.liveNodes() << endl;
+    }
+}
+
+// Двоичное дерево случайной формы: корень каждого поддерева выбирается среди его узлов равновероятно
+BinaryTree* generateRandomBinaryTree(const vector<int>& keys, int lo, int hi, mt19937& rng) {
+    if (lo > hi) return nullptr;
+
+    int rootIndex = lo + (int)(rng() % (unsigned)(hi - lo + 1));
+    BinaryTree* node = binaryTreeArena.create(keys[rootIndex]);
+    node->left = generateRandomBinaryTree(keys, lo, rootIndex - 1, rng);
+    node->right = generateRandomBinaryTree(keys, rootIndex + 1, hi, rng);
+    return node;
+}
+
+// Масштабирование построения АВЛ дерева из двоичного по числу потоков, по этапам конвейера
+void benchmarkParallelConvert(int count) {
+    vector<int> keys = generateRandomKeys(count, 31);
+    mt19937 rng(32);
+    BinaryTree* binaryRoot = generateRandomBinaryTree(keys, 0, count - 1, rng);
+
+    auto start = chrono::steady_clock::now();
+    vector<int> elements;
+    collectPreOrder(binaryRoot, elements);
+    double collectMs = elapsedMs(start);
+    start = chrono::steady_clock::now();
+    sortAndDedup(elements);
+    double sortMs = elapsedMs(start);
+    start = chrono::steady_clock::now();
+    AVLTree* sequential = buildBalancedAVL(elements);
+    double buildMs = elapsedMs(start);
+    double sequentialMs = collectMs + sortMs + buildMs;
+    cout << "Последовательно: сбор " << collectMs << " мс, сортировка " << sortMs << " мс, построение "
+         << buildMs << " мс, всего " << sequentialMs << " мс" << endl;
+
+    unsigned hardwareThreads = max(thread::hardware_concurrency(), 1u);
+    vector<unsigned> threadCounts;
+    for (unsigned threadCount = 1; threadCount < hardwareThreads; threadCount *= 2) {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    for (unsigned threadCount : threadCounts) {
+        WorkStealingPool pool(threadCount - 1);
+
+        start = chrono::steady_clock::now();
+        vector<int> parallelElements;
+        collectPreOrderParallel(binaryRoot, parallelElements, pool);
+        collectMs = elapsedMs(start);
+        bool sameOrder = parallelElements == [&]() { vector<int> v; collectPreOrder(binaryRoot, v); return v; }();
+
+        start = chrono::steady_clock::now();
+        parallelSortAndDedup(parallelElements, pool);
+        sortMs = elapsedMs(start);
+        start = chrono::steady_clock::now();
+        AVLTree* parallel = buildBalancedAVLParallel(parallelElements, pool);
+        buildMs = elapsedMs(start);
+        double totalMs = collectMs + sortMs + buildMs;
+
+        bool consistent = sameOrder && parallelElements == elements && getHeight(parallel) == getHeight(sequential);
+        cout << "Потоков " << threadCount << ": сбор " << collectMs << " мс, сортировка " << sortMs
+             << " мс, построение " << buildMs << " мс, всего " << totalMs << " мс, ускорение "
+             << sequentialMs / totalMs << "x" << (consistent ? "" : " (результат расходится!)") << endl;
+        deleteAVLTree(parallel);
+    }
+
+    deleteAVLTree(sequential);
+    deleteBinaryTree(binaryRoot);
+}
 
-    if (balance > 1 && key > node->left->data) {
-        node->left = leftRotate(node->left);
-        return rightRotate(node);
+// Параллельные свёртка и обход в ширину на разном числе потоков против последовательных
+void benchmarkParallelTraversal(int count) {
+    vector<int> keys = generateRandomKeys(count, 91);
+    sortAndDedup(keys);
+    AVLTree* root = buildBalancedAVL(keys);
+
+    SummaryVisit visit;
+    auto start = chrono::steady_clock::now();
+    TreeSummary expected = foldTree(root, EMPTY_TREE_SUMMARY, visit);
+    double foldMs = elapsedMs(start);
+    start = chrono::steady_clock::now();
+    vector<int> expectedOrder;
+    VectorSink sink{ expectedOrder };
+    breadthFirstAVL(root, sink);
+    double bfsMs = elapsedMs(start);
+    cout << "Последовательно: свёртка " << foldMs << " мс, обход в ширину " << bfsMs << " мс" << endl;
+
+    unsigned hardwareThreads = max(thread::hardware_concurrency(), 1u);
+    vector<unsigned> threadCounts;
+    for (unsigned threadCount = 1; threadCount < hardwareThreads; threadCount *= 2) {
+        threadCounts.push_back(threadCount);
     }
-
-    if (balance < -1 && key < node->right->data) {
-        node->right = rightRotate(node->right);
-        return leftRotate(node);
+    threadCounts.push_back(hardwareThreads);
+
+    for (unsigned threadCount : threadCounts) {
+        WorkStealingPool pool(threadCount - 1);
+
+        start = chrono::steady_clock::now();
+        TreeSummary summary = summarizeTree(root, pool);
+        double parallelFoldMs = elapsedMs(start);
+        start = chrono::steady_clock::now();
+        vector<int> order;
+        collectBreadthFirstParallel(root, order, pool);
+        double parallelBfsMs = elapsedMs(start);
+
+        bool consistent = summary.count == expected.count && summary.sum == expected.sum &&
+                          summary.minKey == expected.minKey && summary.maxKey == expected.maxKey && order == expectedOrder;
+        cout << "Потоков " << threadCount << ": свёртка " << parallelFoldMs << " мс (ускорение "
+             << foldMs / parallelFoldMs << "x), обход в ширину " << parallelBfsMs << " мс (ускорение "
+             << bfsMs / parallelBfsMs << "x)" << (consistent ? "" : " (результат расходится!)") << endl;
     }
 
-    return node;
+    deleteAVLTree(root);
 }
 
-AVLTree* searchAVL(AVLTree* root, int key) {
-    if (!root || root->data == key)
-        return root;
-    if (key < root->data)
-        return searchAVL(root->left, key);
-    else
-        return searchAVL(root->right, key);
+// Сохранение и загрузка АВЛ дерева в бинарном формате против повторного построения из ключей
+void benchmarkTreeFile(int count) {
+    const string filename = "benchmark_tree.bin";
+    vector<int> keys = generateRandomKeys(count, 41);
+
+    auto start = chrono::steady_clock::now();
+    vector<int> sorted = keys;
+    sortAndDedup(sorted);
+    AVLTree* built = buildBalancedAVL(sorted);
+    double rebuildMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    bool saved = saveAVLTreeFile(built, filename);
+    double saveMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    AVLTree* loaded = saved ? loadAVLTreeFile(filename) : nullptr;
+    double loadMs = elapsedMs(start);
+
+    vector<int> before, after;
+    collectInOrderAVL(built, before);
+    collectInOrderAVL(loaded, after);
+    bool same = before == after && getHeight(built) == getHeight(loaded);
+
+    cout << "Сортировка и сборка из ключей: " << rebuildMs << " мс" << endl;
+    cout << "Сохранение: " << saveMs << " мс, загрузка: " << loadMs << " мс"
+         << (same ? "" : " (загруженное дерево отличается!)") << endl;
+
+    deleteAVLTree(built);
+    deleteAVLTree(loaded);
+    remove(filename.c_str());
 }
 
-AVLTree* minValueNode(AVLTree* node) {
-    AVLTree* current = node;
-    while (current->left != nullptr)
-        current = current->left;
-    return current;
+void runBenchmarks(int count) {
+    cout << "\n=== Построение ===" << endl;
+    benchmarkBuildAVL(count);
+    cout << "\n=== Поиск ===" << endl;
+    benchmarkSearchAVL(count);
+    cout << "\n=== Параллельное построение из двоичного дерева ===" << endl;
+    benchmarkParallelConvert(count);
+    cout << "\n=== Параллельные обходы ===" << endl;
+    benchmarkParallelTraversal(count);
+    cout << "\n=== Бинарный формат ===" << endl;
+    benchmarkTreeFile(count);
+    cout << "\n=== Вставка и удаление ===" << endl;
+    testPathCheckAfterDelete();
+    benchmarkInsertDeleteAVL(count);
+    cout << "\n=== Компактные узлы ===" << endl;
+    benchmarkCompactAVL(count);
+    cout << "\n=== Обобщённое дерево AVLMap ===" << endl;
+    benchmarkAVLMap(count);
+    cout << "\n=== Ключи, известные при сборке ===" << endl;
+    benchmarkStaticKeySet(count);
+    cout << "\n=== Обходы без стека ===" << endl;
+    benchmarkTraversalMemory(count);
+    cout << "\n=== Операции над множествами ===" << endl;
+    benchmarkSetOperationsAVL(count);
+    cout << "\n=== Буфер записи ===" << endl;
+    benchmarkIngestBuffer(count);
+    cout << "\n=== Многопоточный доступ ===" << endl;
+    stressTestConcurrentAVL(min(count, 100000), 3, 500);
+    benchmarkConcurrentAVL(count);
+    cout << "\n=== Персистентные версии ===" << endl;
+    benchmarkPersistentAVL(count);
 }
 
-AVLTree* deleteAVL(AVLTree* root, int key) {
-    if (!root) return root;
+// Набор замеров для запуска из командной строки (--bench): каждая операция над деревьями
+// на заданных размерах и распределениях ключей, вывод таблицей, CSV или JSON
 
-    if (key < root->data) {
-        root->left = deleteAVL(root->left, key);
-    }
-    else if (key > root->data) {
-        root->right = deleteAVL(root->right, key);
+enum KeyDistribution {
+    KEYS_UNIFORM,
+    KEYS_SORTED,
+    KEYS_REVERSE,
+    KEYS_ZIPF
+};
+
+const char* distributionName(KeyDistribution distribution) {
+    switch (distribution) {
+    case KEYS_UNIFORM: return "uniform";
+    case KEYS_SORTED: return "sorted";
+    case KEYS_REVERSE: return "reverse";
+    case KEYS_ZIPF: return "zipf";
     }
-    else {
-        if (!root->left || !root->right) {
-            AVLTree* temp = root->left ? root->left : root->right;
-            if (!temp) {
-                temp = root;
-                root = nullptr;
-            }
-            else {
-                *root = *temp; 
-            }
-            delete temp;
-        }
-        else {
-            AVLTree* temp = minValueNode(root->right);
-            root->data = temp->data;
-            root->right = deleteAVL(root->right, temp->data);
+    return "";
+}
+
+bool parseDistribution(const string& name, KeyDistribution& distribution) {
+    const KeyDistribution all[] = { KEYS_UNIFORM, KEYS_SORTED, KEYS_REVERSE, KEYS_ZIPF };
+    for (KeyDistribution candidate : all) {
+        if (name == distributionName(candidate)) {
+            distribution = candidate;
+            return true;
         }
     }
+    return false;
+}
 
-    if (!root) return root;
-
-    root->height = 1 + max(getHeight(root->left), getHeight(root->right));
-    int balance = getBalance(root);
-
-    if (balance > 1 && getBalance(root->left) >= 0) return rightRotate(root);
-    if (balance > 1 && getBalance(root->left) < 0) {
-        root->left = leftRotate(root->left);
-        return rightRotate(root);
+// Ранги по закону Ципфа с показателем skew; ранг переводится в ключ перемешивающим умножением,
+// чтобы частые ключи не шли подряд
+vector<int> generateZipfKeys(int count, double skew, unsigned seed) {
+    vector<double> cdf(count);
+    double sum = 0;
+    for (int rank = 0; rank < count; rank++) {
+        sum += 1.0 / pow(rank + 1.0, skew);
+        cdf[rank] = sum;
     }
-    if (balance < -1 && getBalance(root->right) <= 0) return leftRotate(root);
-    if (balance < -1 && getBalance(root->right) > 0) {
-        root->right = rightRotate(root->right);
-        return leftRotate(root);
-    }
-    return root;
-}
 
-void printAVLTree(AVLTree* root, int level = 0) {
-    if (root == nullptr) {
-        return;
+    mt19937 rng(seed);
+    uniform_real_distribution<double> uniform(0, sum);
+    vector<int> keys(count);
+    for (int& key : keys) {
+        unsigned rank = (unsigned)(lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+        key = (int)(rank * 2654435761u >> 1);
     }
-    printAVLTree(root->right, level + 1);
-    cout << setw(level * 4) << "";
-    cout << "--> " << root->data << " (h:" << root->height << ")" << endl;
-    printAVLTree(root->left, level + 1);
+    return keys;
 }
 
-void deleteAVLTree(AVLTree* root) {
-    if (root == nullptr) return;
+vector<int> generateKeys(KeyDistribution distribution, int count, unsigned seed) {
+    if (distribution == KEYS_ZIPF) return generateZipfKeys(count, 0.99, seed);
 
-    deleteAVLTree(root->left);
-    deleteAVLTree(root->right);
-    delete root;
+    vector<int> keys = generateRandomKeys(count, seed);
+    if (distribution == KEYS_SORTED) sort(keys.begin(), keys.end());
+    if (distribution == KEYS_REVERSE) sort(keys.begin(), keys.end(), greater<int>());
+    return keys;
 }
 
-// Обходы для АВЛ дерева
-void breadthFirstTraversalAVL(AVLTree* root) {
-    if (!root) return;
-
-    AVLTreeQueue q(100);
-    q.enqueue(root);
+// Запись двоичного дерева в скобочном виде, обратная parseBinaryTree
+void writeBracketTree(BinaryTree* root, string& out) {
+    struct Pending {
+        BinaryTree* node;
+        char text;
+    };
+    TraversalBuffer<Pending>& stack = traversalScratch<Pending>();
+    if (root) stack.push({ root, 0 });
+    while (!stack.isEmpty()) {
+        Pending current = stack.pop();
+        if (!current.node) {
+            out += current.text;
+            continue;
+        }
 
-    cout << "Обход в ширину: ";
-    while (!q.isEmpty()) {
-        AVLTree* current = q.dequeue();
-        cout << current->data << " ";
+        char number[16];
+        char* end = to_chars(number, number + sizeof(number), current.node->data).ptr;
+        out += '(';
+        out.append(number, end);
 
-        if (current->left) q.enqueue(current->left);
-        if (current->right) q.enqueue(current->right);
+        stack.push({ nullptr, ')' });
+        if (current.node->right) stack.push({ current.node->right, 0 });
+        if (current.node->left) stack.push({ current.node->left, 0 });
+        else if (current.node->right) out += "()";
     }
-    cout << endl;
 }
 
-void preorderIterativeAVL(AVLTree* root) {
-    if (!root) return;
+// Поток вывода, отбрасывающий всё, чтобы замерять обходы без вывода на консоль
+class NullStreamBuffer : public streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
 
-    AVLTreeStack stack(100);
-    stack.push(root);
+    streamsize xsputn(const char*, streamsize count) override {
+        return count;
+    }
+};
 
-    cout << "Прямой обход: ";
-    while (!stack.isEmpty()) {
-        AVLTree* current = stack.pop();
-        cout << current->data << " ";
+struct BenchmarkResult {
+    string operation;
+    string distribution;
+    int size;
+    long long operations;
+    double totalNs;
+    double p50Ns;
+    double p90Ns;
+    double p99Ns;
+    double maxNs;
+    double nodeAllocations;
+    double slabAllocations;
+};
 
-        if (current->right) stack.push(current->right);
-        if (current->left) stack.push(current->left);
-    }
-    cout << endl;
-}
+// Запись в атомарную переменную — наблюдаемый эффект, который компилятор не может убрать
+atomic<size_t> benchmarkSink(0);
 
-void inorderIterativeAVL(AVLTree* root) {
-    if (!root) return;
+class BenchmarkSuite {
+public:
+    BenchmarkSuite() : repeats(5), timerOverheadNs(calibrateTimer()) {}
 
-    AVLTreeStack stack(100);
-    AVLTree* current = root;
+    vector<int> sizes;
+    vector<KeyDistribution> distributions;
+    int repeats;
 
-    cout << "Симметричный обход: ";
-    while (current || !stack.isEmpty()) {
-        while (current) {
-            stack.push(current);
-            current = current->left;
+    void run() {
+        for (int size : sizes) {
+            for (KeyDistribution distribution : distributions) {
+                runOne(size, distribution);
+            }
         }
+        benchmarkSink.store(foundCount, memory_order_relaxed);
+    }
 
-        current = stack.pop();
-        cout << current->data << " ";
-        current = current->right;
+    void printText(ostream& out) const {
+        out << left << setw(12) << "operation" << setw(9) << "keys" << right << setw(10) << "size"
+            << setw(12) << "ns/op" << setw(14) << "ops/s" << setw(10) << "p50" << setw(10) << "p90"
+            << setw(10) << "p99" << setw(12) << "max" << setw(12) << "allocs/op" << setw(8) << "slabs" << "\n";
+        for (const BenchmarkResult& r : results) {
+            out << left << setw(12) << r.operation << setw(9) << r.distribution << right << setw(10) << r.size
+                << setw(12) << fixed << setprecision(1) << meanNs(r) << setw(14) << setprecision(0) << opsPerSecond(r)
+                << setw(10) << setprecision(1) << r.p50Ns << setw(10) << r.p90Ns << setw(10) << r.p99Ns
+                << setw(12) << r.maxNs << setw(12) << setprecision(3) << r.nodeAllocations / r.operations
+                << setw(8) << setprecision(0) << r.slabAllocations << "\n";
+        }
+        out << defaultfloat << setprecision(6);
     }
-    cout << endl;
-}
 
-void postorderIterativeAVL(AVLTree* root) {
-    if (!root) return;
+    void printCsv(ostream& out) const {
+        out << "operation,distribution,size,operations,mean_ns,ops_per_sec,p50_ns,p90_ns,p99_ns,max_ns,"
+               "node_allocs_per_op,slab_allocs\n";
+        for (const BenchmarkResult& r : results) {
+            out << r.operation << ',' << r.distribution << ',' << r.size << ',' << r.operations << ','
+                << meanNs(r) << ',' << opsPerSecond(r) << ',' << r.p50Ns << ',' << r.p90Ns << ','
+                << r.p99Ns << ',' << r.maxNs << ',' << r.nodeAllocations / r.operations << ','
+                << r.slabAllocations << "\n";
+        }
+    }
 
-    AVLTreeStack stack1(100), stack2(100);
-    stack1.push(root);
+    void printJson(ostream& out) const {
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchmarkResult& r = results[i];
+            out << "  {\"operation\": \"" << r.operation << "\", \"distribution\": \"" << r.distribution
+                << "\", \"size\": " << r.size << ", \"operations\": " << r.operations
+                << ", \"mean_ns\": " << meanNs(r) << ", \"ops_per_sec\": " << opsPerSecond(r)
+                << ", \"p50_ns\": " << r.p50Ns << ", \"p90_ns\": " << r.p90Ns << ", \"p99_ns\": " << r.p99Ns
+                << ", \"max_ns\": " << r.maxNs << ", \"node_allocs_per_op\": " << r.nodeAllocations / r.operations
+                << ", \"slab_allocs\": " << r.slabAllocations << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
 
-    cout << "Обратный обход: ";
-    while (!stack1.isEmpty()) {
-        AVLTree* current = stack1.pop();
-        stack2.push(current);
+private:
+    typedef chrono::steady_clock Clock;
 
-        if (current->left) stack1.push(current->left);
-        if (current->right) stack1.push(current->right);
+    static double nanoseconds(Clock::time_point start, Clock::time_point end) {
+        return (double)chrono::duration_cast<chrono::nanoseconds>(end - start).count();
     }
 
-    while (!stack2.isEmpty()) {
-        cout << stack2.pop()->data << " ";
+    // Минимальное время между двумя соседними чтениями часов вычитается из замеров одной операции
+    static double calibrateTimer() {
+        double best = 1e9;
+        for (int i = 0; i < 1000; i++) {
+            Clock::time_point a = Clock::now();
+            Clock::time_point b = Clock::now();
+            best = min(best, nanoseconds(a, b));
+        }
+        return best;
     }
-    cout << endl;
-}
 
-bool isDigit(char c) {
-    return c >= '0' && c <= '9';
-}
+    static double meanNs(const BenchmarkResult& r) {
+        return r.operations ? r.totalNs / r.operations : 0;
+    }
 
-bool isValidBinaryTreeString(const string& str) {
-    int balance = 0;
-    for (char c : str) {
-        if (c == '(') balance++;
-        else if (c == ')') balance--;
-        if (balance < 0) return false;
+    static double opsPerSecond(const BenchmarkResult& r) {
+        return r.totalNs > 0 ? r.operations * 1e9 / r.totalNs : 0;
     }
-    return balance == 0;
-}
 
-BinaryTree* parseBinaryTreeFromString(const string& str, size_t& pos) {
-    while (pos < str.length() && str[pos] == ' ') pos++;
+    // Замер серии одиночных операций над деревом, которое готовит setup. Среднее и выделения
+    // берутся из прохода без часов, перцентили — из второго прохода на новом дереве, где время
+    // каждой операции записывается отдельно за вычетом стоимости чтения часов
+    template <typename Setup, typename Operation>
+    void measureEach(const char* name, KeyDistribution distribution, const vector<int>& keys, Setup setup,
+                     Operation operation) {
+        AVLTree* root = setup();
+        size_t nodesBefore = avlTreeArena.createdNodes();
+        size_t slabsBefore = avlTreeArena.allocatedSlabs();
+        Clock::time_point total = Clock::now();
+        for (int key : keys) {
+            operation(root, key);
+        }
+        double totalNs = nanoseconds(total, Clock::now());
+        size_t nodes = avlTreeArena.createdNodes() - nodesBefore;
+        size_t slabs = avlTreeArena.allocatedSlabs() - slabsBefore;
+        deleteAVLTree(root);
+
+        root = setup();
+        vector<double> samples(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            Clock::time_point start = Clock::now();
+            operation(root, keys[i]);
+            samples[i] = max(nanoseconds(start, Clock::now()) - timerOverheadNs, 0.0);
+        }
+        deleteAVLTree(root);
 
-    if (pos >= str.length() || str[pos] != '(') {
-        return nullptr;
+        record(name, distribution, (int)keys.size(), (long long)keys.size(), totalNs, samples, (double)nodes, (double)slabs);
     }
 
-    pos++; 
-    while (pos < str.length() && str[pos] == ' ') pos++;
+    // Замер операции над всем деревом, повторённой repeats раз; операций в одном повторе — size
+    template <typename Operation>
+    void measureRepeated(const char* name, KeyDistribution distribution, int size, Operation operation) {
+        vector<double> samples;
+        double totalNs = 0;
+        size_t nodesBefore = avlTreeArena.createdNodes() + binaryTreeArena.createdNodes();
+        size_t slabsBefore = avlTreeArena.allocatedSlabs() + binaryTreeArena.allocatedSlabs();
+
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            Clock::time_point start = Clock::now();
+            operation();
+            double ns = nanoseconds(start, Clock::now());
+            totalNs += ns;
+            samples.push_back(ns / size);
+        }
 
-    if (pos < str.length() && str[pos] == ')') {
-        pos++;
-        return nullptr;
+        size_t nodes = avlTreeArena.createdNodes() + binaryTreeArena.createdNodes() - nodesBefore;
+        size_t slabs = avlTreeArena.allocatedSlabs() + binaryTreeArena.allocatedSlabs() - slabsBefore;
+        record(name, distribution, size, (long long)size * repeats, totalNs, samples, (double)nodes, (double)slabs);
     }
 
-    string numStr = "";
-    bool isNegative = false;
+    void record(const char* name, KeyDistribution distribution, int size, long long operations, double totalNs,
+                vector<double>& samples, double nodes, double slabs) {
+        sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) {
+            return samples.empty() ? 0 : samples[min(samples.size() - 1, (size_t)(p * samples.size()))];
+        };
+
+        BenchmarkResult result;
+        result.operation = name;
+        result.distribution = distributionName(distribution);
+        result.size = size;
+        result.operations = operations;
+        result.totalNs = totalNs;
+        result.p50Ns = percentile(0.50);
+        result.p90Ns = percentile(0.90);
+        result.p99Ns = percentile(0.99);
+        result.maxNs = samples.empty() ? 0 : samples.back();
+        result.nodeAllocations = nodes;
+        result.slabAllocations = slabs;
+        results.push_back(result);
+    }
 
-    if (str[pos] == '-') {
-        isNegative = true;
-        pos++;
+    void runOne(int size, KeyDistribution distribution) {
+        vector<int> keys = generateKeys(distribution, size, 1000 + size);
+        vector<int> queries = generateKeys(distribution, size, 2000 + size);
+
+        // Разбор и преобразование — на двоичном дереве случайной формы с ключами из распределения
+        mt19937 rng(3000 + size);
+        BinaryTree* shape = generateRandomBinaryTree(keys, 0, size - 1, rng);
+        string text;
+        writeBracketTree(shape, text);
+
+        measureRepeated("parse", distribution, size, [&]() {
+            size_t pos = 0;
+            deleteBinaryTree(parseBinaryTreeFromString(text, pos));
+        });
+        measureRepeated("convert", distribution, size, [&]() {
+            AVLTree* converted = nullptr;
+            convertToAVL(shape, converted, false);
+            deleteAVLTree(converted);
+        });
+        deleteBinaryTree(shape);
+
+        auto emptyTree = []() { return (AVLTree*)nullptr; };
+        auto filledTree = [&]() {
+            AVLTree* tree = nullptr;
+            for (int key : keys) tree = insertAVL(tree, key);
+            return tree;
+        };
+        measureEach("insert", distribution, keys, emptyTree, [](AVLTree*& tree, int key) { tree = insertAVL(tree, key); });
+        measureEach("search", distribution, queries, filledTree, [this](AVLTree*& tree, int key) {
+            foundCount += searchAVL(tree, key) != nullptr;
+        });
+        measureEach("delete", distribution, keys, filledTree, [](AVLTree*& tree, int key) { tree = deleteAVL(tree, key); });
+        // Поиск начала диапазона и проход по 16 следующим ключам
+        measureEach("scan16", distribution, queries, filledTree, [this](AVLTree*& tree, int key) {
+            AVLTreeIterator it = lowerBoundAVL(tree, key);
+            AVLTreeIterator end = AVLTreeIterator::end(tree);
+            size_t sum = 0;
+            for (int i = 0; i < 16 && it != end; i++, ++it) sum += *it;
+            foundCount += sum;
+        });
+
+        // Сами обходы — в пустой приёмник, отдельно — вывод текста в поток без консоли
+        AVLTree* root = filledTree();
+        NullSink sink;
+        measureRepeated("bfs", distribution, size, [&]() { breadthFirstAVL(root, sink); });
+        measureRepeated("preorder", distribution, size, [&]() { preorderAVL(root, sink); });
+        measureRepeated("inorder", distribution, size, [&]() { inorderAVL(root, sink); });
+        measureRepeated("postorder", distribution, size, [&]() { postorderAVL(root, sink); });
+        measureRepeated("morris-pre", distribution, size, [&]() { morrisPreorderAVL(root, sink); });
+        measureRepeated("morris-in", distribution, size, [&]() { morrisInorderAVL(root, sink); });
+        measureRepeated("morris-post", distribution, size, [&]() { morrisPostorderAVL(root, sink); });
+        foundCount += sink.checksum;
+
+        NullStreamBuffer nullBuffer;
+        streambuf* console = cout.rdbuf(&nullBuffer);
+        measureRepeated("print-in", distribution, size, [&]() { inorderIterativeAVL(root); });
+        cout.rdbuf(console);
+        deleteAVLTree(root);
     }
 
-    while (pos < str.length() && isDigit(str[pos])) {
-        numStr += str[pos];
-        pos++;
+    double timerOverheadNs;
+    // Результаты поиска накапливаются и в конце run() уходят в benchmarkSink, чтобы компилятор
+    // не выбросил сами поиски
+    size_t foundCount = 0;
+    vector<BenchmarkResult> results;
+};
+
+vector<string> splitList(const string& text) {
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
     }
+    return items;
+}
 
-    if (numStr.empty()) {
-        return nullptr;
+// ConsoleApplication26 --bench [--sizes=1000,100000] [--dists=uniform,sorted,reverse,zipf]
+//                      [--repeat=5] [--format=text|csv|json] [--output=файл]
+int runBenchmarkSuite(int argc, char* argv[]) {
+    BenchmarkSuite suite;
+    string format = "text";
+    string output;
+
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        size_t equals = argument.find('=');
+        string name = argument.substr(0, equals);
+        string value = equals == string::npos ? "" : argument.substr(equals + 1);
+
+        if (name == "--bench") continue;
+        if (name == "--sizes") {
+            for (const string& size : splitList(value)) suite.sizes.push_back(atoi(size.c_str()));
+        }
+        else if (name == "--dists") {
+            for (const string& dist : splitList(value)) {
+                KeyDistribution distribution;
+                if (!parseDistribution(dist, distribution)) {
+                    cerr << "Неизвестное распределение: " << dist << endl;
+                    return 1;
+                }
+                suite.distributions.push_back(distribution);
+            }
+        }
+        else if (name == "--repeat") suite.repeats = max(atoi(value.c_str()), 1);
+        else if (name == "--format") format = value;
+        else if (name == "--output") output = value;
+        else {
+            cerr << "Неизвестный параметр: " << argument << endl;
+            return 1;
+        }
     }
+    if (suite.sizes.empty()) suite.sizes = { 1000, 100000 };
+    if (suite.distributions.empty()) suite.distributions = { KEYS_UNIFORM, KEYS_SORTED, KEYS_REVERSE, KEYS_ZIPF };
+    for (int size : suite.sizes) {
+        if (size <= 0) {
+            cerr << "Размер должен быть положительным" << endl;
+            return 1;
+        }
+    }
+    if (format != "text" && format != "csv" && format != "json") {
+        cerr << "Неизвестный формат: " << format << endl;
+        return 1;
+    }
+
+    suite.run();
 
-    int num = stoi(numStr);
-    if (isNegative) {
-        num = -num;
+    ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+        if (!file.is_open()) {
+            cerr << "Ошибка открытия файла!" << endl;
+            return 1;
+        }
     }
+    ostream& out = output.empty() ? cout : file;
+    if (format == "csv") suite.printCsv(out);
+    else if (format == "json") suite.printJson(out);
+    else suite.printText(out);
+    return 0;
+}
 
-    BinaryTree* node = new BinaryTree(num);
+// Пакетный режим: команды по одной в строке из файла или stdin, без меню.
+//   insert k | delete k | find k   — операции над АВЛ деревом
+//   load файл                      — загрузить двоичное дерево (скобочная запись или бинарный файл)
+//                                    и построить из него АВЛ дерево
+//   traverse bfs|pre|in|post       — обход АВЛ дерева; morris-pre|morris-in|morris-post — без стека,
+//                                    parallel-bfs — по уровням в пуле потоков
+//   check                          — проверка балансировки
+//   stats                          — число ключей, сумма, минимум и максимум АВЛ дерева
+//   tree-stats [reset]             — счётчики сборки с TREE_STATS в JSON; reset обнуляет их после вывода
+//   rank k | select i | count a b  — число ключей меньше k, i-й ключ с нуля, число ключей в [a, b]
+//   range a b                      — ключи из [a, b] по возрастанию
+//   union|intersect|subtract файл  — объединение, пересечение или разность с деревом из файла
+// Результаты find пишутся как "found k" / "missing k", порядковых запросов — "rank k r",
+// "select i ключ" или "select i none", "count a b c", "range a b k1 k2 ...". Подряд идущие find выполняются
+// одним пакетным поиском, insert и delete копятся в буфере записи. Ошибки с номером строки пишутся в stderr
+class BatchRunner {
+public:
+    BatchRunner() : out(stdout), binaryTree(nullptr), avlTree(nullptr), commands(0), errors(0) {}
+
+    ~BatchRunner() {
+        binaryTreeArena.release();
+        avlTreeArena.release();
+    }
 
-    node->left = parseBinaryTreeFromString(str, pos);
+    void run(const char* text, size_t length) {
+        streambuf* console = cout.rdbuf(&out);
+        size_t pos = 0;
+        size_t line = 1;
+        while (pos < length) {
+            size_t end = pos;
+            while (end < length && text[end] != '\n') end++;
+            runLine(text + pos, end - pos, line);
+            pos = end + 1;
+            line++;
+        }
+        flushFinds();
+        out.flush();
+        cout.rdbuf(console);
+    }
 
-    node->right = parseBinaryTreeFromString(str, pos);
+    size_t commandCount() const {
+        return commands;
+    }
 
-    while (pos < str.length() && str[pos] == ' ') pos++;
-    if (pos < str.length() && str[pos] == ')') {
-        pos++;
+    size_t errorCount() const {
+        return errors;
     }
 
-    return node;
-}
+private:
+    static bool isWord(const char* word, size_t length, const char* expected) {
+        return strlen(expected) == length && memcmp(word, expected, length) == 0;
+    }
 
-BinaryTree* createBinaryTreeFromFile(const string& filename) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cout << "Ошибка открытия файла!" << endl;
-        return nullptr;
+    void fail(size_t line, const char* message) {
+        cerr << "Строка " << line << ": " << message << endl;
+        errors++;
     }
 
-    string line;
-    getline(file, line);
-    file.close();
+    void runLine(const char* text, size_t length, size_t line) {
+        size_t pos = 0;
+        while (pos < length && isSpace(text[pos])) pos++;
+        if (pos == length || text[pos] == '#') return;
+
+        size_t wordStart = pos;
+        while (pos < length && !isSpace(text[pos])) pos++;
+        const char* word = text + wordStart;
+        size_t wordLength = pos - wordStart;
+        while (pos < length && isSpace(text[pos])) pos++;
+
+        size_t argumentEnd = length;
+        while (argumentEnd > pos && isSpace(text[argumentEnd - 1])) argumentEnd--;
+        commands++;
+
+        bool isFind = isWord(word, wordLength, "find");
+        if (isFind || isWord(word, wordLength, "insert") || isWord(word, wordLength, "delete")) {
+            int key;
+            const char* message = parseIntAt(text, argumentEnd, pos, key);
+            if (!message && pos != argumentEnd) message = "лишние символы после числа";
+            if (message) {
+                fail(line, message);
+                return;
+            }
 
-    cout << "Прочитанная строка из файла: " << line << endl;
+            if (isFind) {
+                pendingFinds.push_back(key);
+                if (pendingFinds.size() >= 4096) flushFinds();
+                return;
+            }
+            flushFinds();
+            if (word[0] == 'i') ingest.insert(key);
+            else ingest.remove(key);
+            if (ingest.isFull()) avlTree = ingest.apply(avlTree);
+            return;
+        }
 
-    if (!isValidBinaryTreeString(line)) {
-        cout << "Ошибка: неверный формат скобочной записи!" << endl;
-        return nullptr;
+        flushFinds();
+        avlTree = ingest.apply(avlTree);
+        if (isWord(word, wordLength, "rank") || isWord(word, wordLength, "select") || isWord(word, wordLength, "count") ||
+            isWord(word, wordLength, "range")) {
+            runOrderQuery(word, wordLength, text, pos, argumentEnd, line);
+            return;
+        }
+
+        string argument(text + pos, argumentEnd - pos);
+        if (isWord(word, wordLength, "load")) {
+            load(argument, line);
+        }
+        else if (isWord(word, wordLength, "traverse")) {
+            traverse(argument, line);
+        }
+        else if (isWord(word, wordLength, "check")) {
+            checkBalance(avlTree);
+        }
+        else if (isWord(word, wordLength, "stats")) {
+            printTreeSummary("АВЛ дерево", avlTree);
+        }
+        else if (isWord(word, wordLength, "tree-stats")) {
+            if (argument.empty() || argument == "reset") printTreeStats(argument == "reset");
+            else fail(line, "ожидалось tree-stats или tree-stats reset");
+        }
+        else if (isWord(word, wordLength, "union") || isWord(word, wordLength, "intersect") ||
+                 isWord(word, wordLength, "subtract")) {
+            AVLTree* other;
+            {
+                DiagnosticsToStderr diagnostics;
+                other = loadAVLTreeAnyFormat(argument);
+            }
+            if (!other) {
+                fail(line, "не удалось загрузить дерево");
+                return;
+            }
+            if (word[0] == 'u') avlTree = unionAVL(avlTree, other, &sharedPool());
+            else if (word[0] == 'i') avlTree = intersectionAVL(avlTree, other, &sharedPool());
+            else avlTree = differenceAVL(avlTree, other, &sharedPool());
+        }
+        else {
+            fail(line, "неизвестная команда");
+        }
     }
 
-    size_t pos = 0;
-    BinaryTree* root = parseBinaryTreeFromString(line, pos);
+    // Ключи пишутся прямо в буфер вывода, строка — как у консольных обходов
+    void traverse(const string& kind, size_t line) {
+        const char* title = traversalTitleAVL(kind);
+        if (!title) {
+            fail(line, "ожидался вид обхода bfs, pre, in, post, parallel-bfs или morris-pre, morris-in, morris-post");
+            return;
+        }
+        if (!avlTree) return;
 
-    if (root == nullptr) {
-        cout << "Ошибка при парсинге дерева!" << endl;
+        out.write(title);
+        WriterSink sink{ out };
+        traverseAVL(avlTree, kind, sink);
+        out.put('\n');
     }
-    else {
-        cout << "Двоичное дерево успешно создано!" << endl;
-    }
-
-    return root;
-}
 
-void convertToAVL(BinaryTree* binaryRoot, AVLTree*& avlRoot) {
-    if (!binaryRoot) return;
-    vector<int> elements;
-    collectPreOrder(binaryRoot, elements);
+    void runOrderQuery(const char* word, size_t wordLength, const char* text, size_t pos, size_t end, size_t line) {
+        int first;
+        int second = 0;
+        bool isCount = isWord(word, wordLength, "count");
+        bool isRange = isWord(word, wordLength, "range");
+        const char* message = parseIntAt(text, end, pos, first);
+        if (!message && (isCount || isRange)) {
+            while (pos < end && isSpace(text[pos])) pos++;
+            message = parseIntAt(text, end, pos, second);
+        }
+        if (!message && pos != end) message = "лишние символы после числа";
+        if (message) {
+            fail(line, message);
+            return;
+        }
 
-    cout << "Элементы в порядке КЛП: ";
-    for (int elem : elements) {
-        cout << elem << " ";
+        out.write(word, wordLength);
+        out.put(' ');
+        out.writeInt(first);
+        out.put(' ');
+        if (isCount) {
+            out.writeInt(second);
+            out.put(' ');
+            out.writeInt(rangeCountAVL(avlTree, first, second));
+        }
+        else if (isRange) {
+            out.writeInt(second);
+            forEachInRangeAVL(avlTree, first, second, [this](int key) {
+                out.put(' ');
+                out.writeInt(key);
+                return true;
+            });
+        }
+        else if (word[0] == 'r') {
+            out.writeInt(rankAVL(avlTree, first));
+        }
+        else {
+            AVLTree* node = selectAVL(avlTree, first);
+            if (node) out.writeInt(node->data);
+            else out.write("none");
+        }
+        out.put('\n');
     }
-    cout << endl;
-    for (int elem : elements) {
-        avlRoot = insertAVL(avlRoot, elem);
+
+    void flushFinds() {
+        if (pendingFinds.empty()) return;
+
+        results.resize(pendingFinds.size());
+        {
+            TREE_STAT(OperationTimer timer(OP_SEARCH_BATCH, pendingFinds.size());)
+            searchAVLBatch(avlTree, pendingFinds.data(), pendingFinds.size(), results.data());
+        }
+        for (size_t i = 0; i < pendingFinds.size(); i++) {
+            int state = ingest.lookup(pendingFinds[i]);
+            bool found = state >= 0 ? state == 1 : results[i] != nullptr;
+            out.write(found ? "found " : "missing ");
+            out.writeInt(pendingFinds[i]);
+            out.put('\n');
+        }
+        pendingFinds.clear();
     }
-}
 
-bool isValidAVL(AVLTree* root) {
-    if (!root) return true;
+    void load(const string& filename, size_t line) {
+        binaryTreeArena.release();
+        avlTreeArena.release();
+        binaryTree = nullptr;
+        avlTree = nullptr;
 
-    int balance = getBalance(root);
-    if (balance < -1 || balance > 1) {
-        cout << "Нарушен баланс в узле " << root->data << ": balance = " << balance << endl;
-        return false;
+        DiagnosticsToStderr diagnostics;
+        TreeFileKind kind = readTreeFileKind(filename);
+        if (kind == TREE_FILE_AVL) avlTree = loadAVLTreeFile(filename);
+        else if (kind == TREE_FILE_BINARY) binaryTree = loadBinaryTreeFile(filename);
+        else binaryTree = createBinaryTreeFromFile(filename);
+
+        if (binaryTree) convertToAVL(binaryTree, avlTree, false);
+        if (!avlTree) fail(line, "не удалось загрузить дерево");
     }
 
-    if (root->left && root->left->data >= root->data) {
-        cout << "Нарушено свойство: " << root->left->data << " >= " << root->data << endl;
-        return false;
+    // Загрузчики написаны для меню и сообщают подробности через cout. В пакетном режиме это не
+    // результат команды, поэтому на время загрузки cout пишет в stderr
+    class DiagnosticsToStderr {
+    public:
+        DiagnosticsToStderr() : results(cout.rdbuf(cerr.rdbuf())) {}
+        DiagnosticsToStderr(const DiagnosticsToStderr&) = delete;
+        DiagnosticsToStderr& operator=(const DiagnosticsToStderr&) = delete;
+
+        ~DiagnosticsToStderr() {
+            cout.rdbuf(results);
+        }
+
+    private:
+        streambuf* results;
+    };
+
+    BufferedWriter out;
+    BinaryTree* binaryTree;
+    AVLTree* avlTree;
+    // Вставки и удаления применяются пачками перед любой командой, кроме find
+    AVLIngestBuffer ingest;
+    vector<int> pendingFinds;
+    vector<AVLTree*> results;
+    size_t commands;
+    size_t errors;
+};
+
+// ConsoleApplication26 --batch [файл]; без файла команды читаются из stdin
+int runBatch(const char* filename) {
+    auto start = chrono::steady_clock::now();
+    MappedFile file;
+    string input;
+    const char* text;
+    size_t length;
+    if (filename) {
+        if (!file.open(filename)) {
+            cerr << "Ошибка открытия файла!" << endl;
+            return 1;
+        }
+        text = file.begin();
+        length = file.size();
     }
-    if (root->right && root->right->data <= root->data) {
-        cout << "Нарушено свойство: " << root->right->data << " <= " << root->data << endl;
-        return false;
+    else {
+        char chunk[1 << 16];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            input.append(chunk, read);
+        }
+        text = input.data();
+        length = input.size();
     }
 
-    return isValidAVL(root->left) && isValidAVL(root->right);
+    BatchRunner runner;
+    runner.run(text, length);
+    double ms = elapsedMs(start);
+    cerr << "Команд: " << runner.commandCount() << ", ошибок: " << runner.errorCount() << ", время: " << ms
+         << " мс (" << (ms > 0 ? runner.commandCount() / ms / 1000 : 0) << " млн команд/с)" << endl;
+    return runner.errorCount() ? 2 : 0;
 }
+
 void displayMenu() {
     cout << "Лаба 3 - деревья" << endl;
     cout << "1. Загрузить двоичное дерево из файла" << endl;
@@ -601,12 +5536,28 @@ void displayMenu() {
     cout << "7. Удаление элемента из АВЛ дерева" << endl;
     cout << "8. Поиск элемента в АВЛ дереве" << endl;
     cout << "9. Проверить балансировку АВЛ дерева" << endl;
+    cout << "10. Замеры производительности" << endl;
+    cout << "11. Сохранить двоичное дерево в бинарный файл" << endl;
+    cout << "12. Сохранить АВЛ дерево в бинарный файл" << endl;
+    cout << "13. Загрузить дерево из бинарного файла" << endl;
+    cout << "14. Порядковые статистики АВЛ дерева" << endl;
+    cout << "15. Операции над множествами с деревом из файла" << endl;
+    cout << "16. Выгрузить обход АВЛ дерева в текстовый файл" << endl;
+    cout << "17. Сводка по деревьям (параллельно)" << endl;
+    cout << "18. Статистика операций в JSON (сборка с TREE_STATS)" << endl;
     cout << "0. Выход" << endl;
     cout << "Выберите действие: ";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     setlocale(0, "");
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        return runBenchmarkSuite(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        return runBatch(argc > 2 ? argv[2] : nullptr);
+    }
+
     BinaryTree* binaryTree = nullptr;
     AVLTree* avlTree = nullptr;
     string filename;
@@ -622,7 +5573,7 @@ int main() {
             cin >> filename;
 
             if (binaryTree) {
-                deleteBinaryTree(binaryTree);
+                binaryTreeArena.release();
                 binaryTree = nullptr;
             }
 
@@ -647,20 +5598,21 @@ int main() {
         case 3: {
             if (binaryTree) {
                 if (avlTree) {
-                    deleteAVLTree(avlTree);
+                    avlTreeArena.release();
                     avlTree = nullptr;
                 }
 
                 convertToAVL(binaryTree, avlTree);
                 cout << "АВЛ дерево успешно создано!" << endl;
 
-                if (isValidAVL(avlTree)) {
-                    cout << "АВЛ дерево корректно!" << endl;
+                if (AVL_FULL_CHECKS) {
+                    if (isValidAVL(avlTree)) {
+                        cout << "АВЛ дерево корректно!" << endl;
+                    }
+                    else {
+                        cout << "Ошибка: АВЛ дерево некорректно!" << endl;
+                    }
                 }
-                else {
-                    cout << "Ошибка: АВЛ дерево некорректно!" << endl;
-                }
-                checkBalance(avlTree);
             }
             else {
                 cout << "Сначала загрузите двоичное дерево!" << endl;
@@ -699,7 +5651,7 @@ int main() {
                 cin >> value;
                 avlTree = insertAVL(avlTree, value);
                 cout << "Элемент вставлен!" << endl;
-                checkBalance(avlTree);
+                checkChangedPath(avlTree, value);
             }
             else {
                 cout << "АВЛ дерево не создано!" << endl;
@@ -719,7 +5671,7 @@ int main() {
                 else {
                     avlTree = deleteAVL(avlTree, value);
                     cout << "Элемент удален!" << endl;
-                    checkBalance(avlTree);
+                    checkChangedPath(avlTree, value);
                 }
             }
             else {
@@ -732,7 +5684,7 @@ int main() {
             if (avlTree) {
                 cout << "Введите значение для поиска: ";
                 cin >> value;
-                if (searchAVL(avlTree, value)) {
+                if (searchFlatAVL(avlTree, value)) {
                     cout << "Элемент найден!" << endl;
                 }
                 else {
@@ -755,9 +5707,153 @@ int main() {
             break;
         }
 
+        case 10: {
+            cout << "Введите количество элементов: ";
+            cin >> value;
+            if (value > 0) {
+                runBenchmarks(value);
+            }
+            else {
+                cout << "Количество должно быть положительным!" << endl;
+            }
+            break;
+        }
+
+        case 11: {
+            if (binaryTree) {
+                cout << "Введите имя файла: ";
+                cin >> filename;
+                if (saveBinaryTreeFile(binaryTree, filename)) {
+                    cout << "Двоичное дерево сохранено!" << endl;
+                }
+            }
+            else {
+                cout << "Двоичное дерево не загружено!" << endl;
+            }
+            break;
+        }
+
+        case 12: {
+            if (avlTree) {
+                cout << "Введите имя файла: ";
+                cin >> filename;
+                if (saveAVLTreeFile(avlTree, filename)) {
+                    cout << "АВЛ дерево сохранено!" << endl;
+                }
+            }
+            else {
+                cout << "АВЛ дерево не создано!" << endl;
+            }
+            break;
+        }
+
+        case 13: {
+            cout << "Введите имя файла: ";
+            cin >> filename;
+
+            auto start = chrono::steady_clock::now();
+            TreeFileKind kind = readTreeFileKind(filename);
+            if (kind == TREE_FILE_BINARY) {
+                binaryTreeArena.release();
+                binaryTree = loadBinaryTreeFile(filename);
+                if (binaryTree) cout << "Двоичное дерево загружено за " << elapsedMs(start) << " мс!" << endl;
+            }
+            else if (kind == TREE_FILE_AVL) {
+                avlTreeArena.release();
+                avlTree = loadAVLTreeFile(filename);
+                if (avlTree) cout << "АВЛ дерево загружено за " << elapsedMs(start) << " мс!" << endl;
+            }
+            else {
+                cout << "Ошибка: файл не является сохранённым деревом!" << endl;
+            }
+            break;
+        }
+
+        case 14: {
+            if (avlTree) {
+                cout << "Всего элементов: " << getSize(avlTree) << endl;
+                cout << "Введите значение для ранга: ";
+                cin >> value;
+                cout << "Элементов меньше " << value << ": " << rankAVL(avlTree, value) << endl;
+
+                cout << "Введите номер элемента (с нуля): ";
+                cin >> value;
+                AVLTree* found = selectAVL(avlTree, value);
+                if (found) cout << "Элемент с номером " << value << ": " << found->data << endl;
+                else cout << "Номер вне диапазона!" << endl;
+
+                int lo, hi;
+                cout << "Введите границы диапазона: ";
+                cin >> lo >> hi;
+                cout << "Элементов в [" << lo << ", " << hi << "]: " << rangeCountAVL(avlTree, lo, hi) << endl;
+            }
+            else {
+                cout << "АВЛ дерево не создано!" << endl;
+            }
+            break;
+        }
+
+        case 15: {
+            cout << "Введите имя файла второго дерева: ";
+            cin >> filename;
+            AVLTree* other = loadAVLTreeAnyFormat(filename);
+            if (!other) {
+                cout << "Второе дерево не загружено!" << endl;
+                break;
+            }
+
+            cout << "1. Объединение" << endl;
+            cout << "2. Пересечение" << endl;
+            cout << "3. Разность" << endl;
+            cout << "Выберите операцию: ";
+            cin >> value;
+            if (value == 1) avlTree = unionAVL(avlTree, other, &sharedPool());
+            else if (value == 2) avlTree = intersectionAVL(avlTree, other, &sharedPool());
+            else if (value == 3) avlTree = differenceAVL(avlTree, other, &sharedPool());
+            else {
+                cout << "Неверная операция!" << endl;
+                deleteAVLTree(other);
+                break;
+            }
+            cout << "В АВЛ дереве элементов: " << getSize(avlTree) << endl;
+            break;
+        }
+
+        case 16: {
+            if (avlTree) {
+                string kind;
+                cout << "Вид обхода (bfs, pre, in, post, parallel-bfs, morris-pre, morris-in, morris-post): ";
+                cin >> kind;
+                cout << "Введите имя файла: ";
+                cin >> filename;
+
+                auto start = chrono::steady_clock::now();
+                if (saveTraversalAVL(avlTree, kind, filename)) {
+                    cout << "Обход выгружен за " << elapsedMs(start) << " мс!" << endl;
+                }
+            }
+            else {
+                cout << "АВЛ дерево не создано!" << endl;
+            }
+            break;
+        }
+
+        case 17: {
+            auto start = chrono::steady_clock::now();
+            printTreeSummary("Двоичное дерево", binaryTree);
+            printTreeSummary("АВЛ дерево", avlTree);
+            cout << "Время: " << elapsedMs(start) << " мс" << endl;
+            break;
+        }
+
+        case 18: {
+            printTreeStats(false);
+            break;
+        }
+
         case 0: {
-            if (binaryTree) deleteBinaryTree(binaryTree);
-            if (avlTree) deleteAVLTree(avlTree);
+            binaryTreeArena.release();
+            avlTreeArena.release();
             cout << "Выход!" << endl;
             return 0;
         }